@@ -0,0 +1,319 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SHARED_MEMORY_CODEC_HPP
+#define SHARED_MEMORY_CODEC_HPP
+
+#include "shared_memory_utils.hpp"
+#include <boost/utility/enable_if.hpp>
+
+namespace shared_memory_interface
+{
+  //Converts between messages and the bytes stored in a slot, using ROS serialization.
+  template<typename T>
+  struct SerializingCodec
+  {
+    static bool rawLayout()
+    {
+      return false;
+    }
+
+    static uint32_t serializedLength(const T& data)
+    {
+      return ros::serialization::serializationLength(data);
+    }
+
+    static void serialize(unsigned char* buffer, uint32_t length, const T& data)
+    {
+      ros::serialization::OStream ostream(buffer, length);
+      ros::serialization::serialize(ostream, data);
+    }
+
+    static void deserialize(unsigned char* buffer, uint32_t length, T& data)
+    {
+      ros::serialization::IStream istream(buffer, length);
+      ros::serialization::deserialize(istream, data);
+    }
+  };
+
+  template<typename T, typename Enable = void>
+  struct MessageCodec : public SerializingCodec<T>
+  {
+  };
+
+  //Fixed-size messages (Float64, Twist, Wrench, ...) whose in-memory layout is identical to their serialized form
+  //are copied as a raw blob instead. The layout check can't be done at compile time, but it only runs once per type,
+  //and a padded type simply keeps using the generic path.
+  template<typename T>
+  struct MessageCodec<T, typename boost::enable_if<ros::message_traits::IsFixedSize<T> >::type>
+  {
+    static bool rawLayout()
+    {
+      static const bool raw_layout = (sizeof(T) == ros::serialization::serializationLength(T()));
+      return raw_layout;
+    }
+
+    static uint32_t serializedLength(const T& data)
+    {
+      return rawLayout()? sizeof(T) : ros::serialization::serializationLength(data);
+    }
+
+    static void serialize(unsigned char* buffer, uint32_t length, const T& data)
+    {
+      if(rawLayout())
+      {
+        memcpy(buffer, &data, sizeof(T));
+        return;
+      }
+      SerializingCodec<T>::serialize(buffer, length, data);
+    }
+
+    static void deserialize(unsigned char* buffer, uint32_t length, T& data)
+    {
+      if(rawLayout())
+      {
+        memcpy(&data, buffer, sizeof(T));
+        return;
+      }
+      SerializingCodec<T>::deserialize(buffer, length, data);
+    }
+  };
+
+  //A message whose type isn't known at compile time, for relays, recorders and bridges that only move bytes around.
+  //Subscriber<RawMessage> hands its callback the serialized bytes without deserializing them, along with the message's
+  //sequence number and the type the field was created with. data points into the subscriber's copy of the slot, so it's
+  //valid (and intact) until the next read. Publisher<RawMessage> publishes length bytes from data as they are, to shared
+  //memory only: roscpp can't advertise a topic whose type it doesn't know, so construct it with write_to_rostopic = false.
+  struct RawMessage
+  {
+    typedef boost::shared_ptr<RawMessage> Ptr;
+    typedef boost::shared_ptr<RawMessage const> ConstPtr;
+
+    RawMessage() :
+        data(NULL), length(0), sequence(0)
+    {
+    }
+
+    const unsigned char* data;
+    uint32_t length;
+    uint32_t sequence; //number of messages published to the field up to and including this one
+    std::string md5sum; //"*" if the field was created by a publisher that didn't know its type either
+    std::string datatype;
+    std::vector<unsigned char> storage; //holds the bytes when the message came in over ROS instead
+  };
+
+  template<>
+  struct MessageCodec<RawMessage>
+  {
+    static bool rawLayout()
+    {
+      return false;
+    }
+
+    static uint32_t serializedLength(const RawMessage& data)
+    {
+      return data.length;
+    }
+
+    static void serialize(unsigned char* buffer, uint32_t length, const RawMessage& data)
+    {
+      memcpy(buffer, data.data, length);
+    }
+
+    static void deserialize(unsigned char* buffer, uint32_t length, RawMessage& data)
+    {
+      data.data = buffer;
+      data.length = length;
+    }
+  };
+
+  //makes a freshly read message independent of the read buffer it came from, for messages that are kept past the next
+  //read. Every deserialized message already is; a RawMessage copies its bytes into its own storage.
+  template<typename T>
+  void detachMessage(T& message)
+  {
+  }
+
+  inline void detachMessage(RawMessage& message)
+  {
+    message.storage.assign(message.data, message.data + message.length);
+    message.data = message.storage.empty()? NULL : &message.storage[0];
+  }
+
+  //A T that's already serialized, e.g. in a slot. ROS publishes it as a T (it has T's md5sum, datatype and definition),
+  //but serializing it is a single memcpy of the bytes, which it doesn't own.
+  template<typename T>
+  struct PreSerialized
+  {
+    PreSerialized(const unsigned char* data, uint32_t length) :
+        data(data), length(length)
+    {
+    }
+
+    const unsigned char* data;
+    uint32_t length;
+  };
+}
+
+namespace ros
+{
+  namespace message_traits
+  {
+    //the type is only known at runtime, like topic_tools::ShapeShifter's
+    template<>
+    struct MD5Sum<shared_memory_interface::RawMessage>
+    {
+      static const char* value()
+      {
+        return "*";
+      }
+
+      static const char* value(const shared_memory_interface::RawMessage& message)
+      {
+        return message.md5sum.c_str();
+      }
+    };
+
+    template<>
+    struct DataType<shared_memory_interface::RawMessage>
+    {
+      static const char* value()
+      {
+        return "*";
+      }
+
+      static const char* value(const shared_memory_interface::RawMessage& message)
+      {
+        return message.datatype.c_str();
+      }
+    };
+
+    template<>
+    struct Definition<shared_memory_interface::RawMessage>
+    {
+      static const char* value()
+      {
+        return "";
+      }
+
+      static const char* value(const shared_memory_interface::RawMessage&)
+      {
+        return "";
+      }
+    };
+
+    template<typename T>
+    struct MD5Sum<shared_memory_interface::PreSerialized<T> >
+    {
+      static const char* value()
+      {
+        return MD5Sum<T>::value();
+      }
+
+      static const char* value(const shared_memory_interface::PreSerialized<T>&)
+      {
+        return MD5Sum<T>::value();
+      }
+    };
+
+    template<typename T>
+    struct DataType<shared_memory_interface::PreSerialized<T> >
+    {
+      static const char* value()
+      {
+        return DataType<T>::value();
+      }
+
+      static const char* value(const shared_memory_interface::PreSerialized<T>&)
+      {
+        return DataType<T>::value();
+      }
+    };
+
+    template<typename T>
+    struct Definition<shared_memory_interface::PreSerialized<T> >
+    {
+      static const char* value()
+      {
+        return Definition<T>::value();
+      }
+
+      static const char* value(const shared_memory_interface::PreSerialized<T>&)
+      {
+        return Definition<T>::value();
+      }
+    };
+  }
+
+  namespace serialization
+  {
+    template<>
+    struct Serializer<shared_memory_interface::RawMessage>
+    {
+      template<typename Stream>
+      inline static void write(Stream& stream, const shared_memory_interface::RawMessage& message)
+      {
+        memcpy(stream.advance(message.length), message.data, message.length);
+      }
+
+      template<typename Stream>
+      inline static void read(Stream& stream, shared_memory_interface::RawMessage& message)
+      {
+        message.length = stream.getLength();
+        message.storage.assign(stream.getData(), stream.getData() + message.length);
+        message.data = message.storage.empty()? NULL : &message.storage[0];
+        stream.advance(message.length);
+      }
+
+      inline static uint32_t serializedLength(const shared_memory_interface::RawMessage& message)
+      {
+        return message.length;
+      }
+    };
+
+    template<typename T>
+    struct Serializer<shared_memory_interface::PreSerialized<T> >
+    {
+      template<typename Stream>
+      inline static void write(Stream& stream, const shared_memory_interface::PreSerialized<T>& message)
+      {
+        memcpy(stream.advance(message.length), message.data, message.length);
+      }
+
+      inline static uint32_t serializedLength(const shared_memory_interface::PreSerialized<T>& message)
+      {
+        return message.length;
+      }
+    };
+  }
+}
+
+#endif //SHARED_MEMORY_CODEC_HPP
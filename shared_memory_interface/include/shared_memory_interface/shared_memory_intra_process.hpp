@@ -0,0 +1,308 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SHARED_MEMORY_INTRA_PROCESS_HPP
+#define SHARED_MEMORY_INTRA_PROCESS_HPP
+
+#include "shared_memory_utils.hpp"
+#include <deque>
+#include <map>
+#include <boost/weak_ptr.hpp>
+#include <boost/function.hpp>
+
+namespace shared_memory_interface
+{
+  //Messages published in a subscriber's own process, waiting for its intra-process thread. A subscriber that falls
+  //behind by more than the publisher's queue_size (or its own capacity) loses the oldest ones, just like it would in
+  //shared memory.
+  template<typename T>
+  class IntraProcessQueue
+  {
+  public:
+    struct Entry
+    {
+      boost::shared_ptr<const T> message;
+      uint64_t publish_ns; //monotonic, like a slot's
+      bool private_copy; //the publisher's own copy, which nobody outside the channel holds, see IntraProcessChannel::take
+    };
+
+    IntraProcessQueue()
+    {
+      m_closed = false;
+      m_capacity = 0;
+      m_dropped = 0;
+    }
+
+    //0 leaves it to the publisher. Set it before the queue joins a channel
+    void setCapacity(unsigned int capacity)
+    {
+      m_capacity = capacity;
+    }
+
+    //what starts the thread that pops the queue. The channel calls it once a publisher in the process shows up, so
+    //subscribers of topics that are only published elsewhere don't keep an idle thread around. Set it before the queue
+    //joins a channel
+    void setConsumer(boost::function<void()> start)
+    {
+      m_start_consumer = start;
+    }
+
+    //called by the channel under its lock, so it runs once
+    void startConsumer()
+    {
+      if(m_start_consumer)
+      {
+        boost::function<void()> start;
+        start.swap(m_start_consumer);
+        start();
+      }
+    }
+
+    void push(const Entry& entry, unsigned int max_size)
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      if(m_capacity != 0)
+      {
+        max_size = std::min(max_size, m_capacity);
+      }
+      m_messages.push_back(entry);
+      while(m_messages.size() > std::max(max_size, 1u))
+      {
+        m_messages.pop_front();
+        m_dropped++;
+      }
+      m_condition.notify_one();
+    }
+
+    //blocks until there's a message, returns false once the queue is closed. dropped is the number of messages lost
+    //since the previous pop
+    bool pop(Entry& entry, uint32_t& dropped)
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while(m_messages.empty() && !m_closed)
+      {
+        m_condition.wait(lock);
+      }
+      if(m_closed)
+      {
+        return false;
+      }
+      entry = m_messages.front();
+      m_messages.pop_front();
+      dropped = m_dropped;
+      m_dropped = 0;
+      return true;
+    }
+
+    void close()
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_closed = true;
+      m_messages.clear();
+      m_condition.notify_all();
+    }
+
+  private:
+    boost::mutex m_mutex;
+    boost::condition_variable m_condition;
+    std::deque<Entry> m_messages;
+    bool m_closed;
+    unsigned int m_capacity;
+    uint32_t m_dropped; //since the last pop
+    boost::function<void()> m_start_consumer; //empty once it ran
+  };
+
+  class IntraProcessChannelBase
+  {
+  public:
+    virtual ~IntraProcessChannelBase()
+    {
+    }
+  };
+
+  //The subscribers of one field that live in this process. Publishers in the same process hand them each message as a
+  //shared pointer instead of serializing it into shared memory for them to deserialize again.
+  template<typename T>
+  class IntraProcessChannel : public IntraProcessChannelBase
+  {
+  public:
+    IntraProcessChannel()
+    {
+      m_num_subscribers = 0;
+      m_has_publishers = false;
+    }
+
+    //new subscribers get the latest message handed out, since they'd miss it in shared memory, see deliver. Their
+    //queue's consumer is only started once the process has a publisher of the field
+    void add(IntraProcessQueue<T>* queue)
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_queues.push_back(queue);
+      m_num_subscribers.store(m_queues.size(), boost::memory_order_relaxed);
+      if(m_has_publishers)
+      {
+        queue->startConsumer();
+      }
+      if(m_latest.message)
+      {
+        queue->push(m_latest, 1);
+      }
+    }
+
+    //starts the consumers of the subscribers that joined so far. Publishers never leave: the threads they started stay
+    //until their subscribers go
+    void addPublisher()
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_has_publishers = true;
+      for(unsigned int i = 0; i < m_queues.size(); i++)
+      {
+        m_queues[i]->startConsumer();
+      }
+    }
+
+    void remove(IntraProcessQueue<T>* queue)
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_queues.erase(std::remove(m_queues.begin(), m_queues.end(), queue), m_queues.end());
+      m_num_subscribers.store(m_queues.size(), boost::memory_order_relaxed);
+    }
+
+    //a single load, so publishers can skip copying messages nobody in the process wants
+    uint32_t numSubscribers()
+    {
+      return m_num_subscribers.load(boost::memory_order_relaxed);
+    }
+
+    //returns false if there was nobody to deliver to. Messages delivered here are marked in shared memory, so the
+    //process' subscribers skip them there, which is why the subscribers that only show up later are given the latest
+    bool deliver(const boost::shared_ptr<const T>& message, unsigned int max_size)
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_latest.message = message;
+      m_latest.private_copy = false;
+      return pushLatest(max_size);
+    }
+
+    //same as deliver, for a copy the publisher made and won't touch again. It's taken out of message, so the channel
+    //and the queues hold the only references to it besides the publisher's pool
+    bool handOver(boost::shared_ptr<const T>& message, unsigned int max_size)
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_latest.message.swap(message);
+      message.reset();
+      m_latest.private_copy = true;
+      return pushLatest(max_size);
+    }
+
+    //true if entry's message is a private copy that only the caller holds now, in which case the caller may change it
+    //(a T& callback gets it without another copy). If it is still the latest message, subscribers that join from now on
+    //aren't given it
+    bool take(const typename IntraProcessQueue<T>::Entry& entry)
+    {
+      if(!entry.private_copy)
+      {
+        return false;
+      }
+      boost::mutex::scoped_lock lock(m_mutex);
+      bool latest = (m_latest.message == entry.message);
+      if(entry.message.use_count() != (latest? 3 : 2)) //the caller's, the publisher's pool's and maybe m_latest
+      {
+        return false; //another subscriber hasn't handled it yet
+      }
+      if(latest)
+      {
+        m_latest.message.reset();
+      }
+      //use_count() is a plain load, so order the other holders' last accesses before our changes
+      boost::atomic_thread_fence(boost::memory_order_acquire);
+      return true;
+    }
+
+  private:
+    //expects m_mutex to be held and m_latest.message to be set
+    bool pushLatest(unsigned int max_size)
+    {
+      if(m_queues.empty())
+      {
+        m_latest.message.reset();
+        return false;
+      }
+      m_latest.publish_ns = monotonicNanoseconds();
+      for(unsigned int i = 0; i < m_queues.size(); i++)
+      {
+        m_queues[i]->push(m_latest, max_size);
+      }
+      return true;
+    }
+
+    boost::mutex m_mutex;
+    std::vector<IntraProcessQueue<T>*> m_queues;
+    boost::atomic<uint32_t> m_num_subscribers;
+    bool m_has_publishers;
+    typename IntraProcessQueue<T>::Entry m_latest; //the last message delivered, if it was delivered here at all
+  };
+
+  //Finds the channel of a field for the publishers and subscribers of this process.
+  class IntraProcessRegistry
+  {
+  public:
+    //returns an empty pointer if the field's channel already carries another message type (a RawMessage subscriber to a
+    //typed topic, say), in which case the caller sticks to shared memory
+    template<typename T>
+    static boost::shared_ptr<IntraProcessChannel<T> > acquire(std::string interface_name, std::string field_name)
+    {
+      boost::mutex::scoped_lock lock(registryMutex());
+      boost::weak_ptr<IntraProcessChannelBase>& entry = registry()[interface_name + ":" + field_name];
+      boost::shared_ptr<IntraProcessChannelBase> channel = entry.lock();
+      if(!channel)
+      {
+        channel.reset(new IntraProcessChannel<T>);
+        entry = channel;
+      }
+      return boost::dynamic_pointer_cast<IntraProcessChannel<T> >(channel);
+    }
+
+  private:
+    static boost::mutex& registryMutex()
+    {
+      static boost::mutex mutex;
+      return mutex;
+    }
+
+    static std::map<std::string, boost::weak_ptr<IntraProcessChannelBase> >& registry()
+    {
+      static std::map<std::string, boost::weak_ptr<IntraProcessChannelBase> > channels;
+      return channels;
+    }
+  };
+}
+#endif //SHARED_MEMORY_INTRA_PROCESS_HPP
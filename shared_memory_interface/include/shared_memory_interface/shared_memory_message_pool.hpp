@@ -0,0 +1,115 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SHARED_MEMORY_MESSAGE_POOL_HPP
+#define SHARED_MEMORY_MESSAGE_POOL_HPP
+
+#include "shared_memory_utils.hpp"
+
+namespace shared_memory_interface
+{
+  //Recycles message objects, so deserializing into one reuses the capacity its vectors and strings grew last time, and
+  //passing a message on to another thread costs a reference count instead of a deep copy.
+  //
+  //The pool keeps a reference to each of its messages. A message whose only reference is the pool's has been released
+  //by everyone it was handed to and can be reused, so no deleter, lock or allocation is involved in getting it back.
+  //Only one thread may allocate from a pool at a time, but messages can be released from any thread.
+  template<typename T>
+  class MessagePool
+  {
+  public:
+    MessagePool(unsigned int capacity = 16, unsigned int preallocate = 2)
+    {
+      m_capacity = std::max(capacity, 1u);
+      m_next = 0;
+      reserve(preallocate);
+    }
+
+    //hands out a message nobody else holds. Its contents are whatever it held last time. If every pooled message is
+    //still held somewhere, the pool grows by one, up to capacity, after which the messages are no longer recycled.
+    boost::shared_ptr<T> allocate()
+    {
+      for(unsigned int i = 0; i < m_messages.size(); i++)
+      {
+        boost::shared_ptr<T>& message = m_messages[m_next];
+        m_next = (m_next + 1) % m_messages.size();
+        if(message.unique())
+        {
+          //unique() is a plain load of the count, so order the holders' last accesses before our reuse ourselves
+          boost::atomic_thread_fence(boost::memory_order_acquire);
+          return message;
+        }
+      }
+
+      boost::shared_ptr<T> message(new T);
+      if(m_messages.size() < m_capacity)
+      {
+        m_messages.push_back(message);
+      }
+      return message;
+    }
+
+    //makes sure count messages exist, so the first messages don't allocate
+    void reserve(unsigned int count)
+    {
+      while(m_messages.size() < std::min(count, m_capacity))
+      {
+        m_messages.push_back(boost::shared_ptr<T>(new T));
+      }
+    }
+
+    //number of messages the pool currently owns
+    unsigned int size()
+    {
+      return m_messages.size();
+    }
+
+    //number of the pool's messages that are held somewhere else right now
+    unsigned int numOutstanding()
+    {
+      unsigned int outstanding = 0;
+      for(unsigned int i = 0; i < m_messages.size(); i++)
+      {
+        if(!m_messages[i].unique())
+        {
+          outstanding++;
+        }
+      }
+      return outstanding;
+    }
+
+  private:
+    std::vector<boost::shared_ptr<T> > m_messages;
+    unsigned int m_capacity;
+    unsigned int m_next; //where the search for a free message starts, so messages are reused round robin
+  };
+}
+#endif //SHARED_MEMORY_MESSAGE_POOL_HPP
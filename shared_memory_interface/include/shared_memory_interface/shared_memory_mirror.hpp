@@ -0,0 +1,184 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SHARED_MEMORY_MIRROR_HPP
+#define SHARED_MEMORY_MIRROR_HPP
+
+#include "shared_memory_utils.hpp"
+#include <boost/scoped_array.hpp>
+
+namespace shared_memory_interface
+{
+#define SM_MIRROR_POLL_US 1000 //how often the mirror thread looks at its queue while messages are coming in
+#define SM_MIRROR_IDLE_POLLS 100 //empty looks before it goes to sleep until the publisher wakes it
+
+  //How a Publisher created with write_to_rostopic mirrors its messages to the ROS topic.
+  //  SYNCHRONOUS:  publish() hands every message to roscpp itself, so roscpp's locks and queueing run on the caller's
+  //                thread.
+  //  ASYNCHRONOUS: publish() only queues the message's sequence id. A background thread copies the message out of its
+  //                slot and hands it to roscpp, SM_MIRROR_POLL_US at a time. When the queue is full, overflow decides which
+  //                message is dropped, and a message whose slot was recycled before the thread got to it is dropped too,
+  //                so give the topic a queue_size that covers the poll interval.
+  struct MirrorPolicy
+  {
+    enum Mode
+    {
+      SYNCHRONOUS, ASYNCHRONOUS
+    };
+
+    enum Overflow
+    {
+      DROP_OLDEST, DROP_NEWEST
+    };
+
+    MirrorPolicy(Mode mode = SYNCHRONOUS, unsigned int queue_size = 64, Overflow overflow = DROP_OLDEST) :
+        mode(mode), queue_size(std::max(queue_size, 1u)), overflow(overflow)
+    {
+    }
+
+    Mode mode;
+    unsigned int queue_size;
+    Overflow overflow;
+  };
+
+  struct MirrorStats
+  {
+    MirrorStats() :
+        mirrored(0), dropped_full(0), dropped_recycled(0)
+    {
+    }
+
+    uint64_t mirrored; //handed to roscpp
+    uint64_t dropped_full; //didn't fit in the queue
+    uint64_t dropped_recycled; //overwritten in shared memory before the mirror thread got to them
+  };
+
+  //Sequence ids of published messages on their way to the mirror thread. One producer (the publishing thread) and one
+  //consumer at a time. push never blocks: with DROP_OLDEST it overwrites the oldest entry, and the consumer notices
+  //because every entry carries the index it was pushed at.
+  class MirrorQueue
+  {
+  public:
+    MirrorQueue(unsigned int capacity, MirrorPolicy::Overflow overflow) :
+        m_capacity(capacity), m_overflow(overflow), m_entries(new boost::atomic<uint64_t>[capacity]), m_head(0), m_tail(0), m_waiters(0), m_dropped(0)
+    {
+      for(unsigned int i = 0; i < m_capacity; i++)
+      {
+        m_entries[i].store(0, boost::memory_order_relaxed);
+      }
+    }
+
+    bool push(uint32_t sequence_id)
+    {
+      uint32_t head = m_head.load(boost::memory_order_relaxed);
+      if(m_overflow == MirrorPolicy::DROP_NEWEST && head - m_tail.load(boost::memory_order_acquire) >= m_capacity)
+      {
+        m_dropped.fetch_add(1, boost::memory_order_relaxed);
+        return false;
+      }
+      m_entries[head % m_capacity].store(((uint64_t) head << 32) | sequence_id, boost::memory_order_release);
+      m_head.store(head + 1, boost::memory_order_release);
+      boost::atomic_thread_fence(boost::memory_order_seq_cst); //pairs with the waiter's increment, see wait
+      if(m_waiters.load(boost::memory_order_relaxed) != 0)
+      {
+        futexWakeAll(&m_head);
+      }
+      return true;
+    }
+
+    //false if the queue is empty
+    bool tryPop(uint32_t& sequence_id)
+    {
+      uint32_t tail = m_tail.load(boost::memory_order_relaxed);
+      while(true)
+      {
+        uint32_t head = m_head.load(boost::memory_order_acquire);
+        if(head == tail)
+        {
+          return false;
+        }
+        if(head - tail > m_capacity) //lapped, the oldest entries have been overwritten
+        {
+          m_dropped.fetch_add(head - m_capacity - tail, boost::memory_order_relaxed);
+          tail = head - m_capacity;
+        }
+
+        uint64_t entry = m_entries[tail % m_capacity].load(boost::memory_order_acquire);
+        uint32_t index = entry >> 32;
+        if(index != tail) //overwritten since we looked at the head, the entries after it are still good
+        {
+          m_dropped.fetch_add(index - m_capacity + 1 - tail, boost::memory_order_relaxed);
+          tail = index - m_capacity + 1;
+          continue;
+        }
+        sequence_id = (uint32_t) entry;
+        m_tail.store(tail + 1, boost::memory_order_release);
+        return true;
+      }
+    }
+
+    //returns once the queue isn't empty, after timeout_ns, or when someone calls wake
+    void wait(uint64_t timeout_ns)
+    {
+      m_waiters.fetch_add(1, boost::memory_order_seq_cst);
+      uint32_t head = m_head.load(boost::memory_order_seq_cst);
+      if(head == m_tail.load(boost::memory_order_acquire))
+      {
+        struct timespec wait_time;
+        wait_time.tv_sec = timeout_ns / 1000000000ULL;
+        wait_time.tv_nsec = timeout_ns % 1000000000ULL;
+        futexWait(&m_head, head, &wait_time);
+      }
+      m_waiters.fetch_sub(1, boost::memory_order_relaxed);
+    }
+
+    void wake()
+    {
+      futexWakeAll(&m_head);
+    }
+
+    uint64_t dropped()
+    {
+      return m_dropped.load(boost::memory_order_relaxed);
+    }
+
+  private:
+    unsigned int m_capacity;
+    MirrorPolicy::Overflow m_overflow;
+    boost::scoped_array<boost::atomic<uint64_t> > m_entries; //the index an entry was pushed at, then the sequence id
+    SMAtomicUInt32 m_head; //entries pushed so far
+    SMAtomicUInt32 m_tail; //entries popped (or skipped) so far
+    SMAtomicUInt32 m_waiters;
+    boost::atomic<uint64_t> m_dropped;
+  };
+}
+
+#endif //SHARED_MEMORY_MIRROR_HPP
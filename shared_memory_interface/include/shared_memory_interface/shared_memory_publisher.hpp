@@ -33,6 +33,10 @@
 #define SHARED_MEMORY_PUBLISHER_HPP
 
 #include "shared_memory_transport_impl.hpp"
+#include "shared_memory_mirror.hpp"
+#include "shared_memory_intra_process.hpp"
+#include "shared_memory_message_pool.hpp"
+#include <boost/scoped_ptr.hpp>
 
 namespace shared_memory_interface
 {
@@ -45,33 +49,256 @@ namespace shared_memory_interface
       m_nh = NULL;
       m_write_to_rostopic = write_to_rostopic;
       advertised = false;
+      m_loan_ptr = NULL;
+      m_mirror_thread = NULL;
+      m_mirror_stop = false;
+      m_ros_listening = false;
+      m_mirrored = 0;
+      m_mirror_dropped_recycled = 0;
+      m_intra_process = true;
+      m_queue_size = 1;
     }
 
     ~Publisher()
     {
+      if(m_mirror_thread != NULL)
+      {
+        m_mirror_stop.store(true, boost::memory_order_release);
+        m_mirror_queue->wake();
+        m_mirror_thread->join();
+        delete m_mirror_thread;
+      }
+      m_ros_publisher.shutdown(); //no more rosSubscriberConnected calls
+    }
+
+    //decides whether publish() mirrors to the ROS topic itself or leaves it to a background thread. Only matters with
+    //write_to_rostopic. Set it before advertising
+    void setMirrorPolicy(const MirrorPolicy& policy)
+    {
+      m_mirror_policy = policy;
+    }
+
+    MirrorStats getMirrorStats()
+    {
+      MirrorStats stats;
+      stats.mirrored = m_mirrored.load(boost::memory_order_relaxed);
+      stats.dropped_full = m_mirror_queue? m_mirror_queue->dropped() : 0;
+      stats.dropped_recycled = m_mirror_dropped_recycled.load(boost::memory_order_relaxed);
+      return stats;
+    }
+
+    //lets subscribers in our own process be handed each message directly instead of through shared memory, see
+    //publish. On by default. Set it before advertising
+    void setIntraProcess(bool enabled)
+    {
+      m_intra_process = enabled;
+    }
+
+    //faults in (and optionally locks) the field's memory when it's created, so the first publish doesn't take page
+    //faults. Set it before advertising
+    void setPrefaultPolicy(const PrefaultPolicy& policy)
+    {
+      m_smt.setPrefaultPolicy(policy);
+    }
+
+    //gives the topic a segment of its own, shared only with the other topics of the same group, so big topics don't
+    //crowd out small ones. size is the segment's size in bytes if this topic is the first in the group, 0 to size it for
+    //this topic alone. Subscribers find the topic either way. Set it before advertising
+    void setSegmentGroup(std::string group, uint64_t size = 0)
+    {
+      m_smt.setSegmentGroup(group, size);
+    }
+
+    //removes the topic from the interface, so it can be advertised anew. Its memory is freed once its subscribers have
+    //noticed, and returned to the OS if it was the last topic in its group
+    bool retire()
+    {
+      advertised = false;
+      {
+        boost::mutex::scoped_lock mirror_lock(m_mirror_mutex);
+        m_mirror_smt.disconnect(); //keeps the field alive otherwise
+      }
+      return m_smt.retireField();
     }
 
-    void advertise(std::string topic_name, std::string shared_memory_interface_name = "smi")
+    //queue_size is the number of messages a subscriber may fall behind by before it starts missing them
+    void advertise(std::string topic_name, std::string shared_memory_interface_name = "smi", unsigned int queue_size = 1)
     {
       m_interface_name = shared_memory_interface_name;
+      m_queue_size = queue_size;
       configureTopicPaths(m_interface_name, topic_name, m_full_ros_topic_path, m_full_topic_path);
-      m_smt.configure(m_interface_name, m_full_topic_path, true);
-      assert(m_smt.connect()); //connection CANNOT fail, since we literally just created the field
+      m_smt.configure(m_interface_name, m_full_topic_path, true, queue_size);
+      if(m_intra_process)
+      {
+        m_intra_channel = IntraProcessRegistry::acquire<T>(m_interface_name, m_full_topic_path);
+        m_intra_pool = MessagePool<T>(std::max(16u, queue_size + 2)); //the subscribers' queues plus the ones being handled
+        if(m_intra_channel)
+        {
+          m_intra_channel->addPublisher();
+        }
+      }
+      //another publisher may have claimed the field a moment before us and still be setting it up, so give it a second
+      if(!m_smt.connect(1000.0))
+      {
+        ROS_ERROR("Shared memory field %s was never finished by the publisher that created it!", m_full_topic_path.c_str());
+      }
 
+      //roscpp won't advertise a topic without a concrete type, and types like RawMessage only learn theirs at runtime
+      if(m_write_to_rostopic && strcmp(ros::message_traits::md5sum<T>(), "*") == 0)
+      {
+        ROS_ERROR("Can't mirror %s to a ROS topic, since its message type isn't known at compile time! Construct the publisher with write_to_rostopic = false. Publishing to shared memory only.", m_full_topic_path.c_str());
+        m_write_to_rostopic = false;
+      }
       if(m_write_to_rostopic)
       {
+        m_mirror_smt.configure(m_interface_name, m_full_topic_path, false);
+        if(m_mirror_policy.mode == MirrorPolicy::ASYNCHRONOUS && !m_mirror_queue)
+        {
+          m_mirror_queue.reset(new MirrorQueue(m_mirror_policy.queue_size, m_mirror_policy.overflow));
+        }
         ros::NodeHandle nh("~");
-        m_ros_publisher = nh.advertise<T>(m_full_ros_topic_path, 1, true);
+        //not latched: we only mirror messages while someone listens, so rosSubscriberConnected sends the latest instead
+        m_ros_publisher = nh.advertise<T>(m_full_ros_topic_path, 1, boost::bind(&Publisher<T>::rosSubscriberConnected, this, _1));
+        if(m_mirror_queue && m_mirror_thread == NULL)
+        {
+          m_mirror_thread = new boost::thread(boost::bind(&Publisher<T>::mirrorThreadFunction, this));
+        }
       }
       advertised = true;
     }
 
+    //Subscribers in our own process get a copy of data straight away, taken from a pool so its arrays are reused. A T&
+    //callback that is the last to get the copy is handed the copy itself, so data is copied once, not twice. The
+    //message is only serialized into shared memory if someone else listens: a subscriber in another process, one in ours
+    //that polls instead of using a callback, or the ROS topic.
     bool publish(T& data)
+    {
+      if(!readyToPublish())
+      {
+        return false;
+      }
+
+      bool delivered_locally = false;
+      if(m_intra_channel && m_intra_channel->numSubscribers() > 0)
+      {
+        boost::shared_ptr<T> copy = m_intra_pool.allocate();
+        *copy = data;
+        detachMessage(*copy);
+        boost::shared_ptr<const T> message(copy);
+        copy.reset();
+        delivered_locally = m_intra_channel->handOver(message, m_queue_size);
+      }
+      return publishToSharedMemory(data, delivered_locally);
+    }
+
+    //same as publish(T&), but subscribers in our own process are handed data itself, so it mustn't be changed afterwards
+    bool publish(const boost::shared_ptr<const T>& data)
+    {
+      if(!readyToPublish())
+      {
+        return false;
+      }
+
+      bool delivered_locally = m_intra_channel && m_intra_channel->numSubscribers() > 0 && m_intra_channel->deliver(data, m_queue_size);
+      return publishToSharedMemory(*data, delivered_locally);
+    }
+
+    //true if a subscriber is listening through shared memory (ROS subscribers aren't counted). It's a single load, so
+    //topics that are only sometimes watched can check it before building each message
+    bool hasSubscribers()
+    {
+      return m_smt.hasReaders();
+    }
+
+    //the number of subscribers listening through shared memory, after dropping the ones that died without saying so
+    uint32_t getNumSubscribers()
+    {
+      return m_smt.getNumReaders();
+    }
+
+    //hands out a writable region of length bytes inside the next slot, to be filled with the serialized message in
+    //place. Nothing is visible to subscribers until publishLoaned is called, and other publishers to the topic wait until
+    //then too. Returns NULL if the region isn't available.
+    unsigned char* loan(uint32_t length)
+    {
+      if(!m_smt.connected() && !m_smt.connect())
+      {
+        ROS_WARN_THROTTLE(1.0, "Tried to loan from an unconfigured shared memory publisher: %s!", m_full_topic_path.c_str());
+        return NULL;
+      }
+      m_loan_ptr = m_smt.beginWrite(length);
+      return m_loan_ptr;
+    }
+
+    //publishes the first length bytes of the loaned region
+    bool publishLoaned(uint32_t length)
+    {
+      boost::mutex::scoped_lock mirror_lock(m_mirror_mutex, boost::defer_lock);
+      bool mirror = false;
+      if(m_write_to_rostopic && m_mirror_policy.mode == MirrorPolicy::SYNCHRONOUS)
+      {
+        mirror_lock.lock();
+        mirror = m_ros_publisher.getNumSubscribers() > 0;
+      }
+
+      if(mirror && m_loan_ptr != NULL) //copied while the slot is still ours, see publishAndMirror
+      {
+        m_mirror_buffer.assign(m_loan_ptr, m_loan_ptr + length);
+      }
+      if(!m_smt.commitWrite(length))
+      {
+        ROS_ERROR("Failed to publish loaned message on topic %s!", m_full_topic_path.c_str());
+        return false;
+      }
+      if(mirror)
+      {
+        m_ros_publisher.publish(PreSerialized<T>(m_mirror_buffer.empty()? NULL : &m_mirror_buffer[0], length));
+        m_mirrored.fetch_add(1, boost::memory_order_relaxed);
+      }
+      queueForMirror();
+      return true;
+    }
+
+  protected:
+    ros::NodeHandle* m_nh;
+    SharedMemoryTransport<T> m_smt;
+    bool advertised;
+
+    std::string m_interface_name;
+    std::string m_full_topic_path;
+    std::string m_full_ros_topic_path;
+
+    bool m_write_to_rostopic;
+    ros::Publisher m_ros_publisher;
+    SharedMemoryTransport<T> m_mirror_smt; //reads messages back for the ROS topic
+    boost::mutex m_mirror_mutex; //orders rosSubscriberConnected against the mirroring in publish and the mirror thread
+    MirrorPolicy m_mirror_policy;
+    boost::scoped_ptr<MirrorQueue> m_mirror_queue; //only with MirrorPolicy::ASYNCHRONOUS
+    boost::thread* m_mirror_thread;
+    boost::atomic<bool> m_mirror_stop;
+    boost::atomic<bool> m_ros_listening; //false once the mirror thread finds nobody listening, until someone connects
+    std::vector<unsigned char> m_mirror_buffer;
+    boost::atomic<uint64_t> m_mirrored;
+    boost::atomic<uint64_t> m_mirror_dropped_recycled;
+
+    unsigned char* m_loan_ptr;
+
+    bool m_intra_process;
+    unsigned int m_queue_size;
+    boost::shared_ptr<IntraProcessChannel<T> > m_intra_channel; //empty unless m_intra_process
+    MessagePool<T> m_intra_pool; //the copies publish(T&) hands to our process' subscribers
+
+    bool readyToPublish()
     {
       if(!m_nh)
       {
         m_nh = new ros::NodeHandle("~");
       }
+      if(!advertised) //never advertised, or retired
+      {
+        ROS_WARN_THROTTLE(1.0, "%s: Tried to publish on a shared memory publisher that isn't advertised: %s!", m_nh->getNamespace().c_str(), m_full_topic_path.c_str());
+        return false;
+      }
       if(!m_smt.connected())
       {
         if(!m_smt.connect())
@@ -81,13 +308,31 @@ namespace shared_memory_interface
           return false;
         }
       }
+      return true;
+    }
 
-      if(m_smt.setData(data))
+    bool publishToSharedMemory(const T& data, bool delivered_locally)
+    {
+      boost::mutex::scoped_lock mirror_lock(m_mirror_mutex, boost::defer_lock);
+      if(m_write_to_rostopic && m_mirror_policy.mode == MirrorPolicy::SYNCHRONOUS)
       {
-        if(m_write_to_rostopic) // && m_ros_publisher.getNumSubscribers() > 0)
+        mirror_lock.lock(); //a ROS subscriber connecting now mustn't get the latest message after this one
+        if(m_ros_publisher.getNumSubscribers() > 0)
         {
-          m_ros_publisher.publish(data);
+          return publishAndMirror(data, delivered_locally);
         }
+      }
+
+      //everyone listening already has it. A subscriber that connects from elsewhere before the next message is written
+      //gets an older one from shared memory first
+      if(delivered_locally && !m_smt.hasReadersBesides(m_intra_channel->numSubscribers()) && !(m_mirror_queue && m_ros_listening.load(boost::memory_order_relaxed)))
+      {
+        return true;
+      }
+
+      if(m_smt.setData(data, delivered_locally))
+      {
+        queueForMirror();
         return true;
       }
       else
@@ -97,17 +342,103 @@ namespace shared_memory_interface
       }
     }
 
-  protected:
-    ros::NodeHandle* m_nh;
-    SharedMemoryTransport<T> m_smt;
-    bool advertised;
+    //serializes data straight into the next slot and hands ROS a copy of those bytes, so the message is only serialized
+    //once. The copy is taken before the commit lets other publishers at the slot, so nobody waits on roscpp
+    bool publishAndMirror(const T& data, bool delivered_locally)
+    {
+      if(!m_smt.setData(data, delivered_locally, &m_mirror_buffer))
+      {
+        ROS_ERROR("%s: Failed to write to topic %s!", m_nh->getNamespace().c_str(), m_full_topic_path.c_str());
+        return false;
+      }
+      m_ros_publisher.publish(PreSerialized<T>(m_mirror_buffer.empty()? NULL : &m_mirror_buffer[0], m_mirror_buffer.size()));
+      m_mirrored.fetch_add(1, boost::memory_order_relaxed);
+      return true;
+    }
 
-    std::string m_interface_name;
-    std::string m_full_topic_path;
-    std::string m_full_ros_topic_path;
+    //all the publishing thread does with MirrorPolicy::ASYNCHRONOUS. The relaxed load keeps messages nobody listens to
+    //out of the queue without asking roscpp, which takes a lock
+    void queueForMirror()
+    {
+      if(m_mirror_queue && m_ros_listening.load(boost::memory_order_relaxed))
+      {
+        m_mirror_queue->push(m_smt.getLastWriteSequence());
+      }
+    }
 
-    bool m_write_to_rostopic;
-    ros::Publisher m_ros_publisher;
+    //Polls the queue while messages are coming in, so the publisher never has to make a syscall to wake us, and only
+    //sleeps on the queue once it's been empty for a while
+    void mirrorThreadFunction()
+    {
+      unsigned int idle_polls = 0;
+      while(!m_mirror_stop.load(boost::memory_order_acquire))
+      {
+        if(idle_polls < SM_MIRROR_IDLE_POLLS)
+        {
+          usleep(SM_MIRROR_POLL_US);
+        }
+        else
+        {
+          m_mirror_queue->wait(100000000); //wake up now and then to see whether we should stop
+        }
+        boost::mutex::scoped_lock mirror_lock(m_mirror_mutex);
+        idle_polls = (mirrorQueued() > 0)? 0 : idle_polls + 1;
+      }
+    }
+
+    //hands everything in the mirror queue to roscpp, copying each message out of its slot first, since the slot may be
+    //recycled while roscpp serializes. Returns the number of messages mirrored. Called with m_mirror_mutex held
+    unsigned int mirrorQueued()
+    {
+      if(!m_mirror_queue || (!m_mirror_smt.connected() && !m_mirror_smt.connect()))
+      {
+        return 0;
+      }
+      uint32_t sequence_id;
+      if(m_ros_publisher.getNumSubscribers() == 0)
+      {
+        m_ros_listening.store(false, boost::memory_order_relaxed); //until rosSubscriberConnected
+        while(m_mirror_queue->tryPop(sequence_id))
+        {
+        }
+        return 0;
+      }
+
+      unsigned int mirrored = 0;
+      while(m_mirror_queue->tryPop(sequence_id))
+      {
+        if(!m_mirror_smt.copySerializedData(sequence_id, m_mirror_buffer))
+        {
+          m_mirror_dropped_recycled.fetch_add(1, boost::memory_order_relaxed);
+          continue;
+        }
+        m_ros_publisher.publish(PreSerialized<T>(m_mirror_buffer.empty()? NULL : &m_mirror_buffer[0], m_mirror_buffer.size()));
+        mirrored++;
+      }
+      m_mirrored.fetch_add(mirrored, boost::memory_order_relaxed);
+      return mirrored;
+    }
+
+    //Messages are only mirrored while someone listens through ROS, so instead of latching, each new ROS subscriber
+    //gets the latest message straight from shared memory
+    void rosSubscriberConnected(const ros::SingleSubscriberPublisher& subscriber)
+    {
+      boost::mutex::scoped_lock mirror_lock(m_mirror_mutex);
+      m_ros_listening.store(true, boost::memory_order_relaxed);
+      if(mirrorQueued() > 0) //the new subscriber got those too
+      {
+        return;
+      }
+      if(!m_mirror_smt.connected() && !m_mirror_smt.connect())
+      {
+        return;
+      }
+      T latest;
+      if(m_mirror_smt.getData(latest))
+      {
+        subscriber.publish(latest);
+      }
+    }
   };
 
 }
@@ -0,0 +1,217 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SHARED_MEMORY_SEGMENT_REGISTRY_HPP
+#define SHARED_MEMORY_SEGMENT_REGISTRY_HPP
+
+#include "shared_memory_utils.hpp"
+#include <map>
+#include <boost/weak_ptr.hpp>
+#include <boost/make_shared.hpp>
+
+namespace shared_memory_interface
+{
+  //One mapping of an interface's segment, shared by every transport in the process that uses that interface, along
+  //with the one watchdog that listens for the manager's shutdown signal. Get them from SegmentRegistry::acquire; the
+  //mapping goes away with the last transport holding it.
+  class SegmentHandle
+  {
+  public:
+    SegmentHandle(std::string interface_name, boost::interprocess::managed_shared_memory* segment) :
+        m_interface_name(interface_name), m_segment(segment), m_shutdown_required(false), m_prefaulted(false), m_locked(false)
+    {
+      m_watchdog_thread = new boost::thread(boost::bind(&SegmentHandle::watchdogFunction, this));
+    }
+
+    ~SegmentHandle()
+    {
+      m_watchdog_thread->interrupt();
+      m_watchdog_thread->join();
+      delete m_watchdog_thread;
+      boost::mutex::scoped_lock lock(m_segment_mutex);
+      delete m_segment;
+    }
+
+    //NULL once the interface has been shut down and unmapped
+    boost::interprocess::managed_shared_memory* segment()
+    {
+      return m_segment;
+    }
+
+    bool shutdownRequired()
+    {
+      return m_shutdown_required.load(boost::memory_order_acquire);
+    }
+
+    //like shutdownRequired, but asks the segment itself instead of waiting up to half a second for the watchdog to
+    //notice, so a segment that was just unlinked is never handed out again. Takes the segment's lock, so only for
+    //connecting, never the data path
+    bool shutdownSignaled()
+    {
+      if(shutdownRequired())
+      {
+        return true;
+      }
+      boost::mutex::scoped_lock lock(m_segment_mutex);
+      if(m_segment == NULL)
+      {
+        return true;
+      }
+      bool* shutdown_required_ptr = m_segment->find<bool>("shutdown_required").first;
+      return shutdown_required_ptr != NULL && *shutdown_required_ptr;
+    }
+
+    std::string getInterfaceName()
+    {
+      return m_interface_name;
+    }
+
+    //faults in (and with lock set, mlocks) the whole mapping. Only the first call per process does any work
+    bool prefault(bool lock)
+    {
+      boost::mutex::scoped_lock segment_lock(m_segment_mutex);
+      if(m_segment == NULL)
+      {
+        return false;
+      }
+      if(m_prefaulted && (m_locked || !lock))
+      {
+        return true;
+      }
+      ROS_ID_INFO_STREAM("Prefaulting" << (lock? " and locking " : " ") << m_segment->get_size() << " bytes of " << m_interface_name);
+      bool success = prefaultMemory(m_segment->get_address(), m_segment->get_size(), lock);
+      m_prefaulted = true;
+      m_locked = lock && success;
+      return success;
+    }
+
+  private:
+    std::string m_interface_name;
+    boost::interprocess::managed_shared_memory* m_segment;
+    boost::mutex m_segment_mutex;
+    boost::atomic<bool> m_shutdown_required;
+    boost::thread* m_watchdog_thread;
+    bool m_prefaulted; //guarded by m_segment_mutex
+    bool m_locked;
+
+    void watchdogFunction()
+    {
+      try
+      {
+        bool* shutdown_required_ptr = NULL;
+        while(ros::ok())
+        {
+          shutdown_required_ptr = m_segment->find<bool>("shutdown_required").first;
+          if(shutdown_required_ptr)
+          {
+            break;
+          }
+          ROS_ID_WARN_THROTTLED_STREAM("Watchdog waiting for shutdown signal field in " << m_interface_name << "...");
+          boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+        }
+
+        while(ros::ok())
+        {
+          if(*shutdown_required_ptr)
+          {
+            m_shutdown_required.store(true, boost::memory_order_release);
+            ROS_ID_WARN_STREAM("Shutdown signal detected! Disconnecting from " << m_interface_name << " in one second!");
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1000)); //give everyone a chance to notice
+            boost::mutex::scoped_lock lock(m_segment_mutex);
+            delete m_segment;
+            m_segment = NULL;
+            ROS_ID_WARN_STREAM("Disconnected from " << m_interface_name << "!");
+            return;
+          }
+          boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+        }
+      }
+      catch(boost::thread_interrupted&) //the last transport let go of us
+      {
+      }
+    }
+  };
+
+  class SegmentRegistry
+  {
+  public:
+    //returns the process' mapping of interface_name, mapping it first if nobody has yet. Returns an empty pointer if
+    //the segment doesn't exist (yet).
+    static boost::shared_ptr<SegmentHandle> acquire(std::string interface_name)
+    {
+      boost::mutex::scoped_lock lock(registryMutex());
+      std::map<std::string, boost::weak_ptr<SegmentHandle> >& handles = registry();
+
+      std::map<std::string, boost::weak_ptr<SegmentHandle> >::iterator it = handles.find(interface_name);
+      if(it != handles.end())
+      {
+        boost::shared_ptr<SegmentHandle> handle = it->second.lock();
+        if(handle && !handle->shutdownSignaled()) //a shut down interface may have been recreated since, so map it again
+        {
+          return handle;
+        }
+      }
+
+      boost::interprocess::managed_shared_memory* segment;
+      try
+      {
+        segment = new boost::interprocess::managed_shared_memory(boost::interprocess::open_only, interface_name.c_str());
+      }
+      catch(boost::interprocess::interprocess_exception &ex)
+      {
+        return boost::shared_ptr<SegmentHandle>();
+      }
+      bool* huge_pages_ptr = segment->find<bool>("huge_pages").first;
+      if(huge_pages_ptr != NULL && *huge_pages_ptr)
+      {
+        adviseHugePages(segment->get_address(), segment->get_size());
+      }
+
+      boost::shared_ptr<SegmentHandle> handle = boost::make_shared<SegmentHandle>(interface_name, segment);
+      handles[interface_name] = handle;
+      return handle;
+    }
+
+  private:
+    static boost::mutex& registryMutex()
+    {
+      static boost::mutex mutex;
+      return mutex;
+    }
+
+    static std::map<std::string, boost::weak_ptr<SegmentHandle> >& registry()
+    {
+      static std::map<std::string, boost::weak_ptr<SegmentHandle> > handles;
+      return handles;
+    }
+  };
+}
+#endif //SHARED_MEMORY_SEGMENT_REGISTRY_HPP
@@ -33,6 +33,9 @@
 #define SHARED_MEMORY_SUBSCRIBER_HPP
 
 #include "shared_memory_transport_impl.hpp"
+#include "shared_memory_wait_set.hpp"
+#include "shared_memory_message_pool.hpp"
+#include "shared_memory_intra_process.hpp"
 
 namespace shared_memory_interface
 {
@@ -44,16 +47,89 @@ namespace shared_memory_interface
     {
       m_nh = NULL;
       m_listen_to_rostopic = listen_to_rostopic;
-      m_use_polling = use_polling;
+      m_wait_strategy = WaitStrategy(use_polling? WaitStrategy::BUSY_SPIN : WaitStrategy::BLOCK);
       m_callback_thread = NULL;
+      m_intra_process = true;
+      m_intra_thread = NULL;
+      m_closing = false;
+    }
+
+    //decides how the callback thread and waitForMessage wait for new messages. Set it before subscribing
+    void setWaitStrategy(const WaitStrategy& strategy)
+    {
+      m_wait_strategy = strategy;
+    }
+
+    //faults in (and optionally locks) the field's memory when connecting, so the first message doesn't take page
+    //faults. Set it before subscribing
+    void setPrefaultPolicy(const PrefaultPolicy& policy)
+    {
+      m_smt.setPrefaultPolicy(policy);
+    }
+
+    //decides whether the callback gets every message or only the latest one. Set it before subscribing
+    void setDeliveryPolicy(const DeliveryPolicy& policy)
+    {
+      m_delivery_policy = policy;
+    }
+
+    //describes the message the callback is handling, or the one waitForMessage returned last. Only meaningful on the
+    //thread that got the message
+    const MessageInfo& getMessageInfo()
+    {
+      return m_message_info;
+    }
+
+    //percentiles of the time from publishing to delivery of the topic's messages, over all of its subscribers, since
+    //the field was created or last reset
+    LatencyStats getLatencyStats()
+    {
+      return m_smt.getLatencyStats();
+    }
+
+    //starts the topic's latency statistics over, for every subscriber
+    void resetLatencyStats()
+    {
+      m_smt.resetLatencyStats();
+    }
+
+    //lets publishers in our own process hand the callback their messages directly instead of through shared memory. On
+    //by default, but only subscribers with a callback thread of their own take part. Set it before subscribing
+    void setIntraProcess(bool enabled)
+    {
+      m_intra_process = enabled;
+    }
+
+    //at most this many messages are recycled for the shared pointer callbacks; keeping more than that alive at once
+    //costs an allocation per message. Set it before subscribing
+    void setMessagePoolCapacity(unsigned int capacity)
+    {
+      m_pool = MessagePool<T>(capacity);
     }
 
     ~Subscriber()
     {
+      {
+        boost::mutex::scoped_lock intra_lock(m_intra_mutex);
+        m_closing = true;
+        if(m_intra_channel)
+        {
+          m_intra_channel->remove(&m_intra_queue);
+        }
+      }
+      m_intra_queue.close();
+      if(m_intra_thread != NULL)
+      {
+        m_intra_thread->join();
+        delete m_intra_thread;
+      }
+
+      //the thread reads the field through m_smt, whose mapping may go away with it, so it has to be done before we are
       if(m_callback_thread != NULL)
       {
+        m_smt.stopWaiting();
         m_callback_thread->interrupt();
-        m_callback_thread->detach();
+        m_callback_thread->join();
         delete m_callback_thread;
       }
     }
@@ -68,6 +144,7 @@ namespace shared_memory_interface
       m_interface_name = shared_memory_interface_name;
       configureTopicPaths(m_interface_name, topic_name, m_full_ros_topic_path, m_full_topic_path);
       m_smt.configure(m_interface_name, m_full_topic_path, false);
+      m_smt.registerReader(); //so publishers know we're here
 
       bool success = true;
       if(!m_smt.connect(1.0))
@@ -92,6 +169,29 @@ namespace shared_memory_interface
       return success;
     }
 
+    //lets wait_set deliver to callback instead of giving this subscriber its own thread
+    bool subscribe(std::string topic_name, boost::function<void(T&)> callback, WaitSet& wait_set, std::string shared_memory_interface_name = "smi")
+    {
+      bool success = subscribe(topic_name, shared_memory_interface_name);
+      return wait_set.add(m_interface_name, m_smt.getDoorbell(), boost::bind(&SharedMemoryTransport<T>::watch, &m_smt, _1, _2), boost::bind(&SharedMemoryTransport<T>::hasNewData, &m_smt), boost::bind(&Subscriber<T>::dispatchOne, this, callback)) && success;
+    }
+
+    //like subscribe(topic, callback), but each message is deserialized into a recycled object from the subscriber's
+    //pool and handed over as a shared pointer, so the callback can keep it or pass it to another thread without copying
+    //it. The message goes back to the pool once every copy of the pointer is gone.
+    bool subscribeShared(std::string topic_name, boost::function<void(const boost::shared_ptr<const T>&)> callback, std::string shared_memory_interface_name = "smi")
+    {
+      bool success = subscribe(topic_name, shared_memory_interface_name);
+      m_callback_thread = new boost::thread(boost::bind(&Subscriber<T>::sharedCallbackThreadFunction, this, &m_smt, callback));
+      return success;
+    }
+
+    bool subscribeShared(std::string topic_name, boost::function<void(const boost::shared_ptr<const T>&)> callback, WaitSet& wait_set, std::string shared_memory_interface_name = "smi")
+    {
+      bool success = subscribe(topic_name, shared_memory_interface_name);
+      return wait_set.add(m_interface_name, m_smt.getDoorbell(), boost::bind(&SharedMemoryTransport<T>::watch, &m_smt, _1, _2), boost::bind(&SharedMemoryTransport<T>::hasNewData, &m_smt), boost::bind(&Subscriber<T>::dispatchOneShared, this, callback)) && success;
+    }
+
     bool waitForMessage(T& msg, double timeout = -1)
     {
       if(!m_nh)
@@ -108,10 +208,11 @@ namespace shared_memory_interface
         ROS_DEBUG_THROTTLE(1.0, "%s: Tried to get message from an unconnected shared memory transport and reconnection attempt failed!", m_nh->getNamespace().c_str());
         return false;
       }
-      if(!m_smt.awaitNewDataPolled(msg, timeout))
+      if(!m_smt.awaitNewData(msg, timeout, m_wait_strategy, latestOnly()))
       {
         return false;
       }
+      recordRead();
 
       return true;
     }
@@ -121,6 +222,24 @@ namespace shared_memory_interface
       return waitForMessage(msg, 0);
     }
 
+    //borrows the next unread message in place, without deserializing it. The bytes are the serialized message and
+    //may be recycled by the publisher at any time, so don't trust anything derived from them until releaseMessage
+    //returns true. Returns false immediately if there is no unread message.
+    bool borrowMessage(const unsigned char*& data, uint32_t& length)
+    {
+      if(!m_smt.connected() && !m_smt.connect())
+      {
+        return false;
+      }
+      return m_smt.borrowNextData(data, length);
+    }
+
+    //returns true if the borrowed message was still intact when the caller finished with it
+    bool releaseMessage()
+    {
+      return m_smt.releaseBorrowedData();
+    }
+
     bool connected()
     {
       return m_smt.connected();
@@ -135,28 +254,144 @@ namespace shared_memory_interface
     std::string m_full_ros_topic_path;
 
     bool m_listen_to_rostopic;
-    bool m_use_polling;
+    WaitStrategy m_wait_strategy;
     ros::Subscriber m_subscriber;
 
     boost::thread* m_callback_thread;
+    T m_dispatch_msg; //reused by dispatchOne when a WaitSet runs our callback
+    MessagePool<T> m_pool; //backs the shared pointer callbacks
 
-    void callbackThreadFunction(SharedMemoryTransport<T>* smt, boost::function<void(T&)> callback)
+    bool m_intra_process;
+    boost::shared_ptr<IntraProcessChannel<T> > m_intra_channel; //empty until the callback thread has connected
+    IntraProcessQueue<T> m_intra_queue;
+    boost::thread* m_intra_thread; //NULL until a publisher in our process joins the channel
+    boost::mutex m_intra_mutex; //orders joining the channel against destruction
+    bool m_closing;
+    boost::mutex m_callback_mutex; //messages from shared memory and from our own process go to the callback one at a time
+    T m_intra_msg; //what a T& callback gets messages from our own process in, when it can't have the publisher's copy
+    DeliveryPolicy m_delivery_policy;
+    MessageInfo m_message_info;
+
+    bool latestOnly()
     {
-      T msg;
-      std::string serialized_data;
+      return m_delivery_policy.mode == DeliveryPolicy::LATEST_ONLY;
+    }
 
-      while(ros::ok()) //wait for the field to at least have something
+    //what a WaitSet delivers once our transport has news
+    bool readNext(T& data)
+    {
+      if(latestOnly())
+      {
+        return m_smt.hasNewData() && m_smt.getData(data);
+      }
+      return m_smt.getNextData(data);
+    }
+
+    void recordLatency(uint64_t publish_ns)
+    {
+      uint64_t now = monotonicNanoseconds();
+      m_smt.recordLatency((now > publish_ns)? now - publish_ns : 0);
+    }
+
+    void recordRead()
+    {
+      if(m_smt.getLastReadSequence() != m_message_info.sequence) //getCurrentMessage may hand out the same one again
+      {
+        recordLatency(m_smt.getLastReadPublishTime());
+      }
+      m_message_info.sequence = m_smt.getLastReadSequence();
+      m_message_info.skipped = m_smt.getLastReadSkipped();
+      m_message_info.total_skipped += m_message_info.skipped;
+      m_message_info.intra_process = false;
+    }
+
+    void recordIntraProcessDelivery(uint32_t dropped, uint64_t publish_ns)
+    {
+      recordLatency(publish_ns);
+      m_message_info.sequence = 0;
+      m_message_info.skipped = dropped;
+      m_message_info.total_skipped += dropped;
+      m_message_info.intra_process = true;
+    }
+
+    //Joins the field's intra-process channel, once we're connected and registered as a reader, so publishers in our
+    //process count us among the readers that don't need shared memory only when we really are one
+    void joinIntraProcess(boost::function<void(const typename IntraProcessQueue<T>::Entry&)> deliver)
+    {
+      boost::mutex::scoped_lock intra_lock(m_intra_mutex);
+      if(!m_intra_process || m_closing)
+      {
+        return;
+      }
+      m_intra_channel = IntraProcessRegistry::acquire<T>(m_interface_name, m_full_topic_path);
+      if(!m_intra_channel)
+      {
+        ROS_DEBUG("%s: Topic %s is published as another type in this process, so we'll read it from shared memory.", m_nh->getNamespace().c_str(), m_full_topic_path.c_str());
+        return;
+      }
+      m_smt.skipLocalDeliveries();
+      if(latestOnly())
+      {
+        m_intra_queue.setCapacity(1);
+      }
+      m_intra_queue.setConsumer(boost::bind(&Subscriber<T>::startIntraThread, this, deliver));
+      m_intra_channel->add(&m_intra_queue);
+    }
+
+    //called by the channel, under its lock, once a publisher in our process joins it. The destructor leaves the channel
+    //before it looks at m_intra_thread, so it sees the thread if there is one
+    void startIntraThread(boost::function<void(const typename IntraProcessQueue<T>::Entry&)> deliver)
+    {
+      m_intra_thread = new boost::thread(boost::bind(&Subscriber<T>::intraThreadFunction, this, deliver));
+    }
+
+    void intraThreadFunction(boost::function<void(const typename IntraProcessQueue<T>::Entry&)> deliver)
+    {
+      typename IntraProcessQueue<T>::Entry entry;
+      uint32_t dropped;
+      while(m_intra_queue.pop(entry, dropped))
       {
-        if(!smt->initialized())
         {
-          ROS_WARN("%s: Shared memory transport was shut down while we were waiting for connections. Stopping callback thread!", m_nh->getNamespace().c_str());
-          return;
+          boost::mutex::scoped_lock callback_lock(m_callback_mutex);
+          recordIntraProcessDelivery(dropped, entry.publish_ns);
+          deliver(entry);
         }
-        if(!smt->connected())
+        entry.message.reset(); //so the publisher can recycle it
+      }
+    }
+
+    //a copy publish(T&) made that nobody else needs anymore is the callback's to change, so it isn't copied again
+    void deliverCopy(boost::function<void(T&)> callback, const typename IntraProcessQueue<T>::Entry& entry)
+    {
+      if(m_intra_channel->take(entry))
+      {
+        callback(const_cast<T&>(*entry.message)); //the pool allocated it as a T
+        return;
+      }
+      m_intra_msg = *entry.message;
+      callback(m_intra_msg);
+    }
+
+    void deliverShared(boost::function<void(const boost::shared_ptr<const T>&)> callback, const typename IntraProcessQueue<T>::Entry& entry)
+    {
+      callback(entry.message);
+    }
+
+    //returns false if the transport was shut down, or we were destroyed, before the field showed up
+    bool waitForConnection(SharedMemoryTransport<T>* smt)
+    {
+      while(ros::ok() && !smt->connected()) //the field has to exist before we can wait on it
+      {
+        if(smt->stoppedWaiting())
         {
-          smt->connect();
+          return false;
         }
-        else if(smt->hasData())
+        if(!smt->initialized())
+        {
+          ROS_WARN("%s: Shared memory transport was shut down while we were waiting for connections. Stopping callback thread!", m_nh->getNamespace().c_str());
+          return false;
+        }
+        if(smt->connect())
         {
           break;
         }
@@ -164,34 +399,125 @@ namespace shared_memory_interface
         usleep(1e5);  // 100ms (10Hz)
         boost::this_thread::interruption_point();
       }
+      return true;
+    }
+
+    void callbackThreadFunction(SharedMemoryTransport<T>* smt, boost::function<void(T&)> callback)
+    {
+      T msg;
+      std::string serialized_data;
 
-      if(getCurrentMessage(msg))
+      if(!waitForConnection(smt))
       {
-        callback(msg);
+        return;
       }
+      joinIntraProcess(boost::bind(&Subscriber<T>::deliverCopy, this, callback, _1));
+
+      //no need to poll for the first message: the wait below blocks on the sequence word until it shows up, and a
+      //freshly connected transport's cursor sits just behind the latest message, so that one is delivered right away
 
-      while(ros::ok())
+      while(ros::ok() && !smt->stoppedWaiting())
       {
+        if(!waitForConnection(smt)) //we're disconnected when the field is retired, so wait for its successor
+        {
+          return;
+        }
         try
         {
-          if(m_use_polling)
+          if(smt->awaitNewData(msg, -1, m_wait_strategy, latestOnly()))
           {
-            smt->awaitNewDataPolled(msg);
+            boost::mutex::scoped_lock callback_lock(m_callback_mutex);
+            recordRead();
+            callback(msg);
           }
-          else
+        }
+        catch(ros::serialization::StreamOverrunException& ex)
+        {
+          ROS_ERROR("%s: Deserialization failed for topic %s! The string was:\n%s", m_nh->getNamespace().c_str(), m_full_topic_path.c_str(), serialized_data.c_str());
+        }
+        boost::this_thread::interruption_point();
+      }
+    }
+
+    void sharedCallbackThreadFunction(SharedMemoryTransport<T>* smt, boost::function<void(const boost::shared_ptr<const T>&)> callback)
+    {
+      if(!waitForConnection(smt))
+      {
+        return;
+      }
+      joinIntraProcess(boost::bind(&Subscriber<T>::deliverShared, this, callback, _1));
+
+      while(ros::ok() && !smt->stoppedWaiting())
+      {
+        if(!waitForConnection(smt)) //we're disconnected when the field is retired, so wait for its successor
+        {
+          return;
+        }
+        try
+        {
+          boost::shared_ptr<T> msg = m_pool.allocate();
+          if(smt->awaitNewData(*msg, -1, m_wait_strategy, latestOnly()))
           {
-            smt->awaitNewData(msg);
+            detachMessage(*msg);
+            boost::mutex::scoped_lock callback_lock(m_callback_mutex);
+            recordRead();
+            callback(msg);
           }
-          callback(msg);
         }
         catch(ros::serialization::StreamOverrunException& ex)
         {
-          ROS_ERROR("%s: Deserialization failed for topic %s! The string was:\n%s", m_nh->getNamespace().c_str(), m_full_topic_path.c_str(), serialized_data.c_str());
+          ROS_ERROR("%s: Deserialization failed for topic %s!", m_nh->getNamespace().c_str(), m_full_topic_path.c_str());
         }
         boost::this_thread::interruption_point();
       }
     }
 
+    bool dispatchOne(boost::function<void(T&)> callback)
+    {
+      if(!m_smt.connected() && !m_smt.connect())
+      {
+        return false;
+      }
+      try
+      {
+        if(readNext(m_dispatch_msg))
+        {
+          recordRead();
+          callback(m_dispatch_msg);
+          return true;
+        }
+      }
+      catch(ros::serialization::StreamOverrunException& ex)
+      {
+        ROS_ERROR("%s: Deserialization failed for topic %s!", m_nh->getNamespace().c_str(), m_full_topic_path.c_str());
+      }
+      return false;
+    }
+
+    bool dispatchOneShared(boost::function<void(const boost::shared_ptr<const T>&)> callback)
+    {
+      if(!m_smt.connected() && !m_smt.connect())
+      {
+        return false;
+      }
+      try
+      {
+        boost::shared_ptr<T> msg = m_pool.allocate();
+        if(readNext(*msg))
+        {
+          detachMessage(*msg);
+          recordRead();
+          callback(msg);
+          return true;
+        }
+      }
+      catch(ros::serialization::StreamOverrunException& ex)
+      {
+        ROS_ERROR("%s: Deserialization failed for topic %s!", m_nh->getNamespace().c_str(), m_full_topic_path.c_str());
+      }
+      return false;
+    }
+
     void blankCallback(const typename T::ConstPtr& msg)
     {
     }
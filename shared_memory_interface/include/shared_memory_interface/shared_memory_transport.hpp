@@ -33,9 +33,229 @@
 #define SHARED_MEMORY_TRANSPORT_HPP
 
 #include "shared_memory_utils.hpp"
+#include "shared_memory_codec.hpp"
+#include "shared_memory_segment_registry.hpp"
 
 namespace shared_memory_interface
 {
+#define SM_WRITER_SPINS 100 //how often a publisher tries for the writer lock before it starts yielding
+#define SM_STALLED_WRITER_NS 1000000000ULL //how long a dead publisher has to sit on the writer lock before it's taken over
+#define SM_MAX_READERS 64 //subscribers that can register with one field, see ReaderEntry
+#define SM_MAX_WATCHES (SM_CACHE_LINE_SIZE / sizeof(SMAtomicUInt64)) //WaitSet members that can watch one field, see FieldHeader::watches
+#define SM_STALE_READER_NS 1000000000ULL //how long a dead subscriber's entry has to go without a heartbeat before it's dropped
+#define SM_MD5SUM_LENGTH 33 //32 hex digits
+#define SM_LATENCY_SUB_BUCKETS 8 //latency buckets per power of two, so a percentile is off by at most 1/8
+#define SM_LATENCY_MAX_BITS 36 //latencies of 2^36 ns (about a minute) and more all land in the last bucket
+#define SM_LATENCY_BUCKETS ((SM_LATENCY_MAX_BITS - 2) * SM_LATENCY_SUB_BUCKETS)
+#define SM_GROUP_SEGMENT_OVERHEAD (256 * 1024) //boost's bookkeeping, the field header and the slot states
+
+  inline unsigned long roundUpToCacheLine(unsigned long size)
+  {
+    return (size + SM_CACHE_LINE_SIZE - 1) / SM_CACHE_LINE_SIZE * SM_CACHE_LINE_SIZE;
+  }
+
+  struct SlotState
+  {
+    SMAtomicUInt32 tag; //seqlock: 2 * sequence_id - 1 while being written, 2 * sequence_id once complete
+    SMAtomicUInt32 length;
+    SMAtomicUInt32 delivered_by; //pid of a publisher that also handed the message to its own process directly, see IntraProcessChannel
+    SMAtomicUInt64 publish_ns; //monotonic time the message was committed, see LatencyHistogram
+  };
+
+  //Payload storage for every slot of a field. A field starts with generation 0 and the writer replaces it with a bigger
+  //generation whenever a message doesn't fit. Old generations live on until the last transport referencing them lets go.
+  struct SlotBuffer
+  {
+    SlotBuffer(uint32_t generation, unsigned long slot_size) :
+        generation(generation), references(0), slot_size(slot_size)
+    {
+    }
+
+    uint32_t generation;
+    uint32_t references; //guarded by the field's generation mutex
+    unsigned long slot_size; //a multiple of the cache line size, so neighbouring slots never share a line
+    boost::interprocess::offset_ptr<unsigned char> data; //cache line aligned
+  };
+
+  //A subscriber registered with a field, so publishers can tell whether anyone's listening. The subscriber updates it on
+  //every message it reads, so each entry gets a cache line of its own.
+  struct ReaderEntry
+  {
+    SMAtomicUInt32 pid; //0 if the entry is free
+    SMAtomicUInt32 id; //tells the subscribers of one process apart
+    SMAtomicUInt32 last_read_sequence;
+    //overruns, reads and read_retries are statistics for tools like smi_top. Only the owner writes them, on a line it
+    //dirties on every read anyway. They carry over when the entry changes hands, so summed over the table they count
+    //everything the field's readers did
+    SMAtomicUInt32 overruns; //messages lost by falling more than queue_size behind
+    SMAtomicUInt64 heartbeat_ns; //coarse monotonic time of the last read, or of the last wakeup while blocked
+    SMAtomicUInt64 reads; //messages taken from the field
+    SMAtomicUInt32 read_retries; //copies started over because the publisher lapped us mid-copy
+    char padding[SM_CACHE_LINE_SIZE - 5 * sizeof(SMAtomicUInt32) - 2 * sizeof(SMAtomicUInt64)];
+  };
+
+  //Latency percentiles of a field in nanoseconds, see LatencyHistogram
+  struct LatencyStats
+  {
+    LatencyStats() :
+        count(0), p50(0), p99(0), p999(0), max(0)
+    {
+    }
+
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+  };
+
+  //Publish-to-delivery latencies of a field's messages, as seen by all of its subscribers. Like an HdrHistogram, each
+  //power of two is split into SM_LATENCY_SUB_BUCKETS buckets, so the buckets are as wide as the error we can live with
+  //at that latency and a couple of hundred of them cover nanoseconds to a minute. Subscribers count their messages in
+  //with a relaxed increment each, and anyone can read percentiles off it while they do.
+  struct LatencyHistogram
+  {
+    SMAtomicUInt64 max_ns; //no total count: stats() sums the buckets, so recording touches one shared line less
+    char padding[SM_CACHE_LINE_SIZE - sizeof(SMAtomicUInt64)];
+    SMAtomicUInt64 buckets[SM_LATENCY_BUCKETS];
+
+    static unsigned int bucketOf(uint64_t ns)
+    {
+      if(ns < SM_LATENCY_SUB_BUCKETS) //the first buckets are one nanosecond wide
+      {
+        return ns;
+      }
+      unsigned int top_bit = 63 - __builtin_clzll(ns);
+      if(top_bit >= SM_LATENCY_MAX_BITS)
+      {
+        return SM_LATENCY_BUCKETS - 1;
+      }
+      return (top_bit - 2) * SM_LATENCY_SUB_BUCKETS + ((ns >> (top_bit - 3)) & (SM_LATENCY_SUB_BUCKETS - 1));
+    }
+
+    //the largest latency that lands in bucket
+    static uint64_t bucketLimit(unsigned int bucket)
+    {
+      if(bucket < SM_LATENCY_SUB_BUCKETS)
+      {
+        return bucket;
+      }
+      unsigned int top_bit = bucket / SM_LATENCY_SUB_BUCKETS + 2;
+      uint64_t sub_bucket = bucket % SM_LATENCY_SUB_BUCKETS;
+      return ((SM_LATENCY_SUB_BUCKETS + sub_bucket + 1) << (top_bit - 3)) - 1;
+    }
+
+    void record(uint64_t ns)
+    {
+      buckets[bucketOf(ns)].fetch_add(1, boost::memory_order_relaxed);
+      uint64_t max = max_ns.load(boost::memory_order_relaxed);
+      while(ns > max && !max_ns.compare_exchange_weak(max, ns, boost::memory_order_relaxed))
+      {
+      }
+    }
+
+    //percentiles are rounded up to the end of their bucket, so they err on the slow side
+    LatencyStats stats()
+    {
+      uint64_t counts[SM_LATENCY_BUCKETS];
+      LatencyStats stats;
+      for(unsigned int i = 0; i < SM_LATENCY_BUCKETS; i++)
+      {
+        counts[i] = buckets[i].load(boost::memory_order_relaxed);
+        stats.count += counts[i];
+      }
+      stats.max = max_ns.load(boost::memory_order_relaxed);
+      stats.p50 = std::min(percentile(counts, stats.count, 0.5), stats.max);
+      stats.p99 = std::min(percentile(counts, stats.count, 0.99), stats.max);
+      stats.p999 = std::min(percentile(counts, stats.count, 0.999), stats.max);
+      return stats;
+    }
+
+    //only approximately, if subscribers are recording at the same time
+    void reset()
+    {
+      for(unsigned int i = 0; i < SM_LATENCY_BUCKETS; i++)
+      {
+        buckets[i].store(0, boost::memory_order_relaxed);
+      }
+      max_ns.store(0, boost::memory_order_relaxed);
+    }
+
+    static uint64_t percentile(const uint64_t* counts, uint64_t total, double fraction)
+    {
+      uint64_t rank = (uint64_t) ceil(fraction * total);
+      uint64_t seen = 0;
+      for(unsigned int i = 0; i < SM_LATENCY_BUCKETS; i++)
+      {
+        seen += counts[i];
+        if(seen >= rank && seen != 0)
+        {
+          return bucketLimit(i);
+        }
+      }
+      return 0;
+    }
+  };
+
+  inline uint32_t nextReaderId()
+  {
+    static boost::atomic<uint32_t> next_id(0);
+    return next_id.fetch_add(1, boost::memory_order_relaxed) + 1;
+  }
+
+  //Everything a transport needs to know about a field, found with a single lookup. The word readers poll, words only
+  //publishers touch, words readers write to, and words that hardly ever change each get their own cache line.
+  struct FieldHeader
+  {
+    FieldHeader(uint32_t num_slots) :
+        sequence(0), retired(0), writer(0), writer_waits(0), bytes_published(0), waiters(0), watchers(0), readers(0), generation(0), num_slots(num_slots), attached(0), ready(0)
+    {
+    }
+
+    SMAtomicUInt32 sequence; //number of messages published so far, 0 until the field holds valid data
+    SMAtomicUInt32 retired; //set when the field is retired, next to the word readers poll anyway. See retireField
+    char sequence_padding[SM_CACHE_LINE_SIZE - 2 * sizeof(SMAtomicUInt32)];
+
+    SMAtomicUInt32 writer; //pid of the publisher that's writing, 0 if none. Publishers write one at a time, see lockWriter
+    SMAtomicUInt32 writer_waits; //times a publisher found another one writing
+    SMAtomicUInt64 bytes_published; //only changed by whoever holds writer
+    char writer_padding[SM_CACHE_LINE_SIZE - 2 * sizeof(SMAtomicUInt32) - sizeof(SMAtomicUInt64)];
+
+    SMAtomicUInt32 waiters; //readers blocked on the sequence futex, so the writer can skip the wake syscall
+    SMAtomicUInt32 watchers; //entries in use in watches, so publishers of fields no WaitSet watches skip the table
+    SMAtomicUInt32 readers; //entries in use in reader_table, so publishers can ask whether anyone's listening with one load
+    char reader_padding[SM_CACHE_LINE_SIZE - 3 * sizeof(SMAtomicUInt32)];
+
+    //the WaitSet members waiting through the interface's Doorbell: the bell's index + 1 in the upper half, the member's
+    //bit below, 0 if the entry is free. Zeroed along with the rest of the header
+    SMAtomicUInt64 watches[SM_MAX_WATCHES];
+
+    SMAtomicUInt32 generation; //generation of the current slot buffer
+    uint32_t num_slots;
+    uint32_t attached; //transports connected to the field, guarded by the interface's directory mutex
+    boost::interprocess::offset_ptr<SlotState> slots;
+    boost::interprocess::offset_ptr<ReaderEntry> reader_table; //SM_MAX_READERS entries
+    boost::interprocess::offset_ptr<LatencyHistogram> latency;
+    boost::interprocess::offset_ptr<SlotBuffer> buffer; //the current generation, guarded by generation_mutex
+    boost::interprocess::interprocess_mutex generation_mutex;
+    char md5sum[SM_MD5SUM_LENGTH]; //of the creator's message type, so tools can read fields whose type they don't know
+    char datatype[SM_MAX_NAME_LENGTH];
+    SMAtomicUInt32 ready; //set once everything above is in place. Until then the field doesn't exist
+  };
+
+  //fills in what a message can't carry itself. Only RawMessage has room for it
+  template<typename T>
+  inline void describeMessage(T& data, uint32_t sequence_id, FieldHeader* header)
+  {
+  }
+
+  inline void describeMessage(RawMessage& data, uint32_t sequence_id, FieldHeader* header)
+  {
+    data.sequence = sequence_id;
+    data.md5sum = header->md5sum;
+    data.datatype = header->datatype;
+  }
+
   template<typename T> //T must be the type of a ros message
   class SharedMemoryTransport
   {
@@ -43,62 +263,143 @@ namespace shared_memory_interface
     SharedMemoryTransport(unsigned long reservation_size = 500000);
     ~SharedMemoryTransport();
 
-    static bool createMemory(std::string interface_name, unsigned int size);
+    static bool createMemory(std::string interface_name, uint64_t size);
     static void destroyMemory(std::string interface_name);
 
     bool initialized();
     bool connected();
-    void configure(std::string interface_name, std::string field_name, bool create_field = false);
+    //puts a field we create into the interface's segment for group instead of the interface's own segment, creating
+    //that segment with size bytes if it doesn't exist yet (0 sizes it for this field alone). Set it before configuring
+    void setSegmentGroup(std::string group, uint64_t size = 0);
+    void configure(std::string interface_name, std::string field_name, bool create_field = false, unsigned int queue_size = 1);
     bool connect(double timeout = 0.0);
+    void disconnect(); //lets go of the field, so it can be reclaimed once retired. connect works again afterwards
+    void setPrefaultPolicy(const PrefaultPolicy& policy); //takes effect on the next connect
     bool createField();
-    bool getData(T& data);
-    bool setData(T& data);
+    bool retireField(); //removes the field from the interface, see the definition for what happens to its memory
+    bool getData(T& data); //reads the most recent message
+    bool getNextData(T& data); //reads the oldest unread message still in the queue
+    //delivered_locally: see skipLocalDeliveries. copy, if given, also gets the serialized bytes, taken while the slot is
+    //still ours
+    bool setData(const T& data, bool delivered_locally = false, std::vector<unsigned char>* copy = NULL);
+
+    //zero-copy access: the bytes are the serialized message, written or read in place in the slot
+    unsigned char* beginWrite(uint32_t length); //grows the slots if length doesn't fit, returns NULL if that fails
+    bool commitWrite(uint32_t length);
+    uint32_t getLastWriteSequence(); //the sequence id of the message we committed last
+    bool copySerializedData(uint32_t sequence_id, std::vector<unsigned char>& buffer); //false if the slot has been recycled
+    bool borrowNextData(const unsigned char*& data, uint32_t& length);
+    bool releaseBorrowedData(); //returns false if the writer recycled the slot while it was borrowed
 
     std::string getFieldName();
+    std::string getMD5Sum(); //of the type the field was created with, "*" if its creator didn't know
+    std::string getDataType();
 
     bool hasData(); //returns true if the field has already been configured
-    bool awaitNewDataPolled(T& data, double timeout = -1);
-    bool awaitNewData(T& data, double timeout = -1);
+    bool hasNewData(); //returns true if there is a message we haven't read yet
+    void watch(uint32_t bell, uint32_t bit); //asks writers to ring a WaitSet's bell on every message, see FieldHeader::watches
+    void registerReader(); //lists us in the field's reader table once connected, see ReaderEntry
+    bool hasReaders(); //a single load, but may still count a subscriber that died recently
+    bool hasReadersBesides(uint32_t count); //same as hasReaders, but true only if more than count subscribers are registered
+    void skipLocalDeliveries(); //getNextData passes over messages our process' publishers already delivered to us directly
+    uint32_t getNumReaders(); //drops the entries of subscribers that died first
+    Doorbell* getDoorbell();
+    bool awaitNewDataPolled(T& data, double timeout = -1); //same as awaitNewData with WaitStrategy::BUSY_SPIN
+    bool awaitNewData(T& data, double timeout = -1); //same as awaitNewData with WaitStrategy::BLOCK
+    bool awaitNewData(T& data, double timeout, const WaitStrategy& strategy, bool latest_only = false); //latest_only: skip to the most recent message
+    void stopWaiting(); //makes every wait, current and future, return false, so a thread blocked in one can be joined
+    bool stoppedWaiting();
+    uint32_t getLastReadSequence(); //the sequence id of the message we read last
+    uint32_t getLastReadSkipped(); //messages between the one we read last and the one before it that we never read
+    uint64_t getLastReadPublishTime(); //monotonic time the message we read last was published
+    void recordLatency(uint64_t latency_ns); //adds a message's publish-to-delivery latency to the field's LatencyHistogram
+    LatencyStats getLatencyStats();
+    void resetLatencyStats();
 
   private:
-    boost::interprocess::managed_shared_memory* segment;
-    boost::thread* m_watchdog_thread;
-    void watchdogFunction();
+    boost::shared_ptr<SegmentHandle> m_interface_handle; //the interface's own segment, shared with every other transport on the interface
+    boost::shared_ptr<SegmentHandle> m_segment_handle; //the segment our field lives in. The interface's own, unless the field is in a group
+    boost::interprocess::managed_shared_memory* segment; //m_segment_handle's mapping
+    FieldDirectory* m_directory_ptr;
+
+    bool copySlot(uint32_t sequence_id, T& data);
+    bool growSlots(uint32_t length);
+    bool lockWriter();
+    void unlockWriter();
+    void claimReaderEntry();
+    void releaseReaderEntry();
+    void claimWatchEntry();
+    void releaseWatchEntry();
+    void ringWatchers(FieldHeader* header);
+    void markRead(uint32_t sequence_id);
+    void countReadRetry();
+    void countOverruns(uint32_t count);
+    void resolveSlotBuffer();
+    void releaseSlotBuffer(SlotBuffer* buffer);
+    void prefault();
+    SlotBuffer* createSlotBuffer(uint32_t generation, unsigned long slot_size);
+    void unlistField(FieldDirectoryEntry* entry); //undoes a createField that failed halfway
+    bool locateField(); //switches to the segment the directory lists the field in, false if it isn't listed (yet)
+    FieldHeader* findFieldHeader(bool attach = false); //NULL if the field doesn't exist (yet). attach counts us in, see disconnect
+    bool checkConnection();
+    bool commitSlot(uint32_t length, bool delivered_locally);
+    void destroyField(FieldHeader* header);
+    bool deserializeReadBuffer(T& data);
+    bool waitForNewData(const WaitStrategy& strategy, uint64_t deadline_ns);
+    bool spinForNewData(uint64_t iterations, uint64_t until_ns, bool pause, bool yield);
+    bool blockForNewData(uint64_t until_ns);
 
     unsigned long m_reservation_size;
+    unsigned int m_queue_size;
 
     bool m_initialized;
     bool m_connected;
+    boost::atomic<bool> m_stop_waiting; //see stopWaiting
     std::string m_interface_name;
     std::string m_field_name;
-    std::string m_even_buffer_name;
-    std::string m_even_length_name;
-    std::string m_odd_buffer_name;
-    std::string m_odd_length_name;
-    std::string m_buffer_sequence_id_name;
-    std::string m_condition_name;
-    std::string m_condition_mutex_name;
-    std::string m_invalid_flag_name;
-    std::string m_exists_flag_name;
-
-    SMCharAllocator* m_string_allocator;
-
-    uint32_t* m_buffer_sequence_id_ptr;
-    bool* m_invalid_ptr;
-    SMString* m_even_string_ptr;
-    unsigned char* m_even_data_ptr;
-    uint32_t* m_even_length_ptr;
-    SMString* m_odd_string_ptr;
-    unsigned char* m_odd_data_ptr;
-    uint32_t* m_odd_length_ptr;
-    boost::interprocess::interprocess_condition* m_condition_ptr;
-    boost::interprocess::interprocess_mutex* m_condition_mutex_ptr;
+    std::string m_segment_group;
+    uint64_t m_segment_group_size;
+
+    //all of these point into the field's header, see FieldHeader
+    FieldHeader* m_field_header_ptr;
+    SMAtomicUInt32* m_buffer_sequence_id_ptr;
+    SMAtomicUInt32* m_generation_ptr;
+    boost::interprocess::interprocess_mutex* m_generation_mutex_ptr;
+    SlotState* m_slot_states_ptr;
+    SMAtomicUInt32* m_waiter_count_ptr;
+    SMAtomicUInt32* m_watcher_count_ptr;
+
+    SlotBuffer* m_slot_buffer_ptr; //the generation we hold a reference to
+    unsigned char* m_ring_data_ptr;
+    uint32_t m_num_slots;
+    unsigned long m_slot_size;
+    Doorbell* m_doorbell_ptr;
+    uint64_t m_watch; //what we list in the field's watches, 0 unless a WaitSet watches us
+    SMAtomicUInt64* m_watch_entry_ptr; //NULL unless we're watched and the table had room
+    bool m_registered_reader;
+    bool m_skip_local_deliveries;
+    bool m_read_delivered_locally; //the message copySlot copied last was marked delivered by a publisher in our process
+    uint64_t m_read_publish_ns; //when the message copySlot copied last was published
+    ReaderEntry* m_reader_entry_ptr; //NULL unless we registered and the table had room
+    PrefaultPolicy m_prefault_policy;
+
+    uint64_t m_last_arrival_ns; //for WaitStrategy::ADAPTIVE
+    uint64_t m_interarrival_ewma_ns;
 
     //remembered flags
     bool m_already_read_valid;
     bool m_already_set_valid;
 
     uint32_t m_last_read_buffer_sequence_id;
+    uint32_t m_borrowed_sequence_id;
+    uint32_t m_write_sequence_id;
+    unsigned char* m_write_ptr; //non-NULL between beginWrite and commitWrite
+    uint32_t m_pid;
+    std::vector<unsigned char> m_read_buffer; //slot contents are copied here and validated before being deserialized (unless the type has a raw layout)
+    uint32_t m_read_length;
+    uint32_t m_dropped_messages;
+    uint32_t m_last_read_skipped;
+    uint32_t m_unreported_skipped; //skipped since the last message we returned, see getLastReadSkipped
   };
 
 }
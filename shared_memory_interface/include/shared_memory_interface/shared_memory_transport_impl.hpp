@@ -41,69 +41,62 @@ namespace shared_memory_interface
   SharedMemoryTransport<T>::SharedMemoryTransport(unsigned long reservation_size)
   {
     m_reservation_size = reservation_size;
+    m_queue_size = 1;
+    m_num_slots = 0;
+    m_dropped_messages = 0;
+    m_last_read_skipped = 0;
+    m_unreported_skipped = 0;
+    m_borrowed_sequence_id = 0;
+    m_write_sequence_id = 0;
+    m_write_ptr = NULL;
+    m_pid = 0;
+    m_registered_reader = false;
+    m_skip_local_deliveries = false;
+    m_read_delivered_locally = false;
+    m_read_publish_ns = 0;
+    m_reader_entry_ptr = NULL;
+    m_slot_buffer_ptr = NULL;
+    m_doorbell_ptr = NULL;
+    m_directory_ptr = NULL;
+    m_segment_group_size = 0;
+    m_watch = 0;
+    m_watch_entry_ptr = NULL;
     m_initialized = false;
     m_connected = false;
-    m_watchdog_thread = NULL;
+    m_stop_waiting = false;
     m_already_read_valid = false;
+    m_last_arrival_ns = 0;
+    m_interarrival_ewma_ns = 0;
     m_already_set_valid = false;
   }
 
   template<typename T>
   SharedMemoryTransport<T>::~SharedMemoryTransport()
   {
-    if(m_watchdog_thread != NULL)
-    {
-      m_watchdog_thread->interrupt();
-      m_watchdog_thread->detach();
-      delete m_watchdog_thread;
-    }
+    disconnect();
   }
 
   template<typename T>
-  void SharedMemoryTransport<T>::watchdogFunction()
+  bool SharedMemoryTransport<T>::initialized()
   {
-    bool* shutdown_required_ptr = NULL;
-    ros::Rate loop_rate(2.0);
-    while(ros::ok())
-    {
-      shutdown_required_ptr = segment->find<bool>("shutdown_required").first;
-      if(shutdown_required_ptr)
-      {
-        break;
-      }
-      ROS_ID_WARN_THROTTLED_STREAM("Watchdog waiting for shutdown signal field...");
-      loop_rate.sleep();
-    }
-
-    while(ros::ok())
-    {
-      if(*shutdown_required_ptr)
-      {
-        m_initialized = false;
-        ROS_ID_WARN_STREAM("Shutdown signal detected! Disconnecting from shared memory in one second!");
-        usleep(1000000);
-        delete segment;
-        ROS_ID_WARN_STREAM("Disconnected from shared memory!");
-        return;
-      }
-      loop_rate.sleep();
-    }
+    return m_initialized && !m_interface_handle->shutdownRequired() && !m_segment_handle->shutdownRequired();
   }
 
   template<typename T>
-  bool SharedMemoryTransport<T>::initialized()
+  bool SharedMemoryTransport<T>::connected()
   {
-    return m_initialized;
+    return m_connected;
   }
 
   template<typename T>
-  bool SharedMemoryTransport<T>::connected()
+  void SharedMemoryTransport<T>::setSegmentGroup(std::string group, uint64_t size)
   {
-    return m_connected;
+    m_segment_group = group;
+    m_segment_group_size = size;
   }
 
   template<typename T>
-  void SharedMemoryTransport<T>::configure(std::string interface_name, std::string field_name, bool create_field)
+  void SharedMemoryTransport<T>::configure(std::string interface_name, std::string field_name, bool create_field, unsigned int queue_size)
   {
     PRINT_TRACE_ENTER
     if(m_initialized)
@@ -116,39 +109,34 @@ namespace shared_memory_interface
     }
     while(ros::ok()) //there's probably a much less silly way to do this...
     {
-      try
+      m_interface_handle = SegmentRegistry::acquire(interface_name);
+      if(m_interface_handle)
       {
-        segment = new boost::interprocess::managed_shared_memory(boost::interprocess::open_only, interface_name.c_str());
         break;
       }
-      catch(boost::interprocess::interprocess_exception &ex) //shared memory hasn't been created yet, so we'll make it
-      {
-        ROS_ID_INFO_THROTTLED_STREAM("Waiting for shared memory space " << interface_name << " to become available (is the manager running?)...");
-      }
+      ROS_ID_INFO_THROTTLED_STREAM("Waiting for shared memory space " << interface_name << " to become available (is the manager running?)...");
       //boost::this_thread::interruption_point();
     }
+    if(!m_interface_handle) //ros shut down first
+    {
+      PRINT_TRACE_EXIT
+      return;
+    }
+    m_segment_handle = m_interface_handle; //until the directory tells us otherwise
+    segment = m_segment_handle->segment();
 
     m_field_name = field_name;
     m_interface_name = interface_name;
-    m_even_buffer_name = m_field_name + "_e";
-    m_even_length_name = m_field_name + "_el";
-    m_odd_buffer_name = m_field_name + "_o";
-    m_odd_length_name = m_field_name + "_ol";
-    m_buffer_sequence_id_name = m_field_name + "_b";
-    m_condition_name = m_field_name + "_c";
-    m_condition_mutex_name = m_field_name + "_cm";
-    m_invalid_flag_name = m_field_name + "_i";
-    m_exists_flag_name = m_field_name + "_ex";
+    m_queue_size = std::max(queue_size, 1u);
 
-    m_string_allocator = new SMCharAllocator(segment->get_segment_manager());
-
-    m_watchdog_thread = new boost::thread(boost::bind(&SharedMemoryTransport::watchdogFunction, this));
+    m_doorbell_ptr = segment->find_or_construct<Doorbell>("doorbell")();
+    m_directory_ptr = segment->find_or_construct<FieldDirectory>("field_directory")();
 
     m_initialized = true;
 
     if(create_field)
     {
-      if(segment->find<bool>(m_exists_flag_name.c_str()).first != NULL) //check to see if someone else created the field
+      if(locateField()) //check to see if someone else created the field
       {
         ROS_ID_WARN_STREAM("Using existing shared memory field for " << m_field_name);
       }
@@ -172,14 +160,14 @@ namespace shared_memory_interface
     }
 
     ROS_ID_DEBUG_THROTTLED_STREAM("Attempting to connect to " << m_interface_name << ":" << m_field_name << ".");
-    if(timeout == 0.0 && (segment->find<bool>(m_exists_flag_name.c_str()).first == NULL))
+    if(timeout == 0.0 && findFieldHeader() == NULL)
     {
       ROS_ID_DEBUG_THROTTLED_STREAM("Failed while attempting to connect to " << m_interface_name << ":" << m_field_name << " with immediate timeout!");
       return false;
     }
     else if(timeout < 0.0)
     {
-      while(segment->find<bool>(m_exists_flag_name.c_str()).first == NULL)
+      while(findFieldHeader() == NULL)
       {
         ROS_ID_WARN_THROTTLED_STREAM("Waiting for field \"" << m_field_name << "\" to exist");
       }
@@ -187,7 +175,7 @@ namespace shared_memory_interface
     else
     {
       boost::posix_time::ptime timeout_time = boost::get_system_time() + boost::posix_time::milliseconds(timeout);
-      while(segment->find<bool>(m_exists_flag_name.c_str()).first == NULL)
+      while(findFieldHeader() == NULL)
       {
         ROS_ID_WARN_THROTTLED_STREAM("Waiting for field \"" << m_field_name << "\" to exist");
         if(boost::get_system_time() >= timeout_time)
@@ -198,17 +186,37 @@ namespace shared_memory_interface
       }
     }
 
-    m_buffer_sequence_id_ptr = segment->find<uint32_t>(m_buffer_sequence_id_name.c_str()).first;
-    m_invalid_ptr = segment->find<bool>(m_invalid_flag_name.c_str()).first;
-    m_even_string_ptr = segment->find<SMString>(m_even_buffer_name.c_str()).first;
-    m_even_data_ptr = (unsigned char*) &(m_even_string_ptr->at(0));
-    m_even_length_ptr = segment->find<uint32_t>(m_even_length_name.c_str()).first;
-    m_odd_string_ptr = segment->find<SMString>(m_odd_buffer_name.c_str()).first;
-    m_odd_data_ptr = (unsigned char*) &(m_odd_string_ptr->at(0));
-    m_odd_length_ptr = segment->find<uint32_t>(m_odd_length_name.c_str()).first;
-    m_condition_ptr = segment->find<boost::interprocess::interprocess_condition>(m_condition_name.c_str()).first;
-    m_condition_mutex_ptr = segment->find<boost::interprocess::interprocess_mutex>(m_condition_mutex_name.c_str()).first;
-    m_last_read_buffer_sequence_id = (*m_buffer_sequence_id_ptr) - 1;
+    m_field_header_ptr = findFieldHeader(true);
+    if(m_field_header_ptr == NULL) //retired since we found it
+    {
+      return false;
+    }
+    m_buffer_sequence_id_ptr = &m_field_header_ptr->sequence;
+    m_num_slots = m_field_header_ptr->num_slots; //the creator decides the depth, not us
+    m_slot_states_ptr = m_field_header_ptr->slots.get();
+    m_generation_ptr = &m_field_header_ptr->generation;
+    m_generation_mutex_ptr = &m_field_header_ptr->generation_mutex;
+    m_waiter_count_ptr = &m_field_header_ptr->waiters;
+    m_watcher_count_ptr = &m_field_header_ptr->watchers;
+    m_pid = getpid(); //getpid is a real syscall these days, too slow for every message
+    std::string md5sum = ros::message_traits::md5sum<T>();
+    if(md5sum != "*" && strcmp(m_field_header_ptr->md5sum, "*") != 0 && md5sum != m_field_header_ptr->md5sum)
+    {
+      ROS_ID_ERROR_STREAM("Field " << m_field_name << " holds " << m_field_header_ptr->datatype << " messages, but we're a transport for " << ros::message_traits::datatype<T>() << "!");
+    }
+    resolveSlotBuffer();
+    prefault();
+    if(m_watch != 0)
+    {
+      claimWatchEntry();
+    }
+    //treat the latest message (if there is one) as unread, so the first read hands it out
+    uint32_t buffer_sequence_id = m_buffer_sequence_id_ptr->load(boost::memory_order_acquire);
+    m_last_read_buffer_sequence_id = (buffer_sequence_id == 0)? 0 : buffer_sequence_id - 1;
+    if(m_registered_reader)
+    {
+      claimReaderEntry();
+    }
 
     m_connected = true;
 
@@ -217,32 +225,109 @@ namespace shared_memory_interface
     return true;
   }
 
+  template<typename T>
+  void SharedMemoryTransport<T>::setPrefaultPolicy(const PrefaultPolicy& policy)
+  {
+    m_prefault_policy = policy;
+  }
+
   template<typename T>
   bool SharedMemoryTransport<T>::createField()
   {
     PRINT_TRACE_ENTER
     TEST_INITIALIZED
 
-    try
+    //claim the name first. Readers that find the entry before the field is ready just keep waiting for it
+    FieldDirectoryEntry* entry;
     {
-      ROS_ID_INFO_STREAM("Creating new shared memory field for " << m_field_name);
-      segment->construct<SMString>(m_even_buffer_name.c_str())(*m_string_allocator);
-      segment->construct<uint32_t>(m_even_length_name.c_str())(m_reservation_size);
-      segment->construct<SMString>(m_odd_buffer_name.c_str())(*m_string_allocator);
-      segment->construct<uint32_t>(m_odd_length_name.c_str())(m_reservation_size);
-      segment->construct<uint32_t>(m_buffer_sequence_id_name.c_str())(0);
+      boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> directory_lock(m_directory_ptr->mutex);
+      if(m_directory_ptr->find(m_field_name) != NULL)
+      {
+        ROS_ID_WARN_STREAM("Shared memory field " << m_field_name << " already exists!");
+        PRINT_TRACE_EXIT
+        return false;
+      }
+      entry = m_directory_ptr->add(m_field_name, m_segment_group);
+      if(entry == NULL)
+      {
+        ROS_ID_ERROR_STREAM("Can't list field " << m_field_name << " in the directory of " << m_interface_name << ": it's full (" << SM_MAX_FIELDS << " fields) or the names are longer than " << SM_MAX_NAME_LENGTH - 1 << " characters!");
+        PRINT_TRACE_EXIT
+        return false;
+      }
+    }
 
-      segment->find<SMString>(m_even_buffer_name.c_str()).first->resize(m_reservation_size);
-      segment->find<SMString>(m_odd_buffer_name.c_str()).first->resize(m_reservation_size);
+    try
+    {
+      //one slot more than the queue depth, so the writer never touches a slot that a reader is entitled to
+      uint32_t num_slots = m_queue_size + 1;
+      //raw layout messages always have the same length, so their slots are sized exactly and the lengths never change
+      unsigned long slot_size = roundUpToCacheLine(MessageCodec<T>::rawLayout()? sizeof(T) : m_reservation_size);
+      uint32_t initial_length = MessageCodec<T>::rawLayout()? sizeof(T) : 0;
 
-      segment->construct<boost::interprocess::interprocess_condition>(m_condition_name.c_str())();
-      segment->construct<boost::interprocess::interprocess_mutex>(m_condition_mutex_name.c_str())();
+      if(!m_segment_group.empty())
+      {
+        std::string segment_name = groupSegmentName(m_interface_name, m_segment_group);
+        boost::shared_ptr<SegmentHandle> handle = SegmentRegistry::acquire(segment_name);
+        if(!handle) //the first field in the group creates its segment
+        {
+          //room for the slots and for growing them once, unless the caller knows better
+          uint64_t size = (m_segment_group_size != 0)? m_segment_group_size : SM_GROUP_SEGMENT_OVERHEAD + 3 * num_slots * slot_size;
+          bool* huge_pages_ptr = m_interface_handle->segment()->find<bool>("huge_pages").first;
+          shared_memory_interface::createMemory(segment_name, size, huge_pages_ptr != NULL && *huge_pages_ptr);
+          handle = SegmentRegistry::acquire(segment_name);
+        }
+        if(!handle)
+        {
+          ROS_ID_ERROR_STREAM("Couldn't create or open segment " << segment_name << " for field " << m_field_name << "!");
+          unlistField(entry);
+          PRINT_TRACE_EXIT
+          return false;
+        }
+        m_segment_handle = handle;
+        segment = m_segment_handle->segment();
+      }
+      ROS_ID_INFO_STREAM("Creating new shared memory field for " << m_field_name << " with " << num_slots << " slots of " << slot_size << " bytes in " << m_segment_handle->getInterfaceName());
 
-      segment->construct<bool>(m_invalid_flag_name.c_str())(true); //field is invalid until someone writes actual data to it
-      segment->construct<bool>(m_exists_flag_name.c_str())(true); //once we construct this, everyone will assume the field exists
+      //anonymous, so the name is free again as soon as the field is retired, even if it takes a while to reclaim
+      void* header_memory = segment->allocate_aligned(sizeof(FieldHeader), SM_CACHE_LINE_SIZE);
+      memset(header_memory, 0, sizeof(FieldHeader));
+      FieldHeader* header = new (header_memory) FieldHeader(num_slots);
+      strncpy(header->md5sum, ros::message_traits::md5sum<T>(), SM_MD5SUM_LENGTH - 1);
+      strncpy(header->datatype, ros::message_traits::datatype<T>(), SM_MAX_NAME_LENGTH - 1);
+      SlotState* slots = (SlotState*) segment->allocate_aligned(num_slots * sizeof(SlotState), SM_CACHE_LINE_SIZE);
+      for(uint32_t slot = 0; slot < num_slots; slot++)
+      {
+        new (&slots[slot]) SlotState;
+        slots[slot].tag.store(0, boost::memory_order_relaxed);
+        slots[slot].length.store(initial_length, boost::memory_order_relaxed);
+        slots[slot].delivered_by.store(0, boost::memory_order_relaxed);
+        slots[slot].publish_ns.store(0, boost::memory_order_relaxed);
+      }
+      header->slots = slots;
+      ReaderEntry* reader_table = (ReaderEntry*) segment->allocate_aligned(SM_MAX_READERS * sizeof(ReaderEntry), SM_CACHE_LINE_SIZE);
+      memset(reader_table, 0, SM_MAX_READERS * sizeof(ReaderEntry)); //every entry starts out free
+      header->reader_table = reader_table;
+      LatencyHistogram* latency = (LatencyHistogram*) segment->allocate_aligned(sizeof(LatencyHistogram), SM_CACHE_LINE_SIZE);
+      memset(latency, 0, sizeof(LatencyHistogram));
+      header->latency = latency;
+      header->num_slots = num_slots;
+      m_num_slots = num_slots;
+      header->buffer = createSlotBuffer(0, slot_size);
+      if(header->buffer == NULL)
+      {
+        unlistField(entry);
+        PRINT_TRACE_EXIT
+        return false;
+      }
+      {
+        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> directory_lock(m_directory_ptr->mutex);
+        entry->header = segment->get_handle_from_address(header);
+      }
+      header->ready.store(1, boost::memory_order_release); //once this is set, everyone will assume the field exists
     }
     catch(boost::interprocess::interprocess_exception &ex)
     {
+      unlistField(entry);
       ROS_ID_ERROR_STREAM("\n\n\n\n=======================================================================================================");
       ROS_ID_ERROR_STREAM("=======================================================================================================");
       ROS_ID_ERROR_STREAM("CRITICAL ERROR! EXCEPTION " << ex.what() << " THROWN WHILE CREATING \"" << m_field_name << "\"! THIS SHOULD NEVER HAPPEN!");
@@ -257,204 +342,1302 @@ namespace shared_memory_interface
     return true;
   }
 
-  inline bool isEven(uint32_t sequence_id)
-  {
-    return sequence_id & 0x1;
-  }
-
+  //Removes the field from the interface's directory, so it can be created anew right away, and disconnects us from it.
+  //Transports still connected elsewhere see the retired flag and disconnect too; the last one to go frees the field's
+  //memory (see disconnect). A field with a group segment takes the segment down with it once it's the last field in
+  //there: everyone who has it mapped lets go of it (see SegmentHandle) and the memory goes back to the OS.
   template<typename T>
-  bool SharedMemoryTransport<T>::getData(T& data)
+  bool SharedMemoryTransport<T>::retireField()
   {
     PRINT_TRACE_ENTER
-    if(!m_already_read_valid && !hasData())
+    CATCH_SHUTDOWN_SIGNAL
+
+    if(!locateField())
     {
+      ROS_ID_WARN_STREAM("Tried to retire field " << m_field_name << ", which isn't listed in " << m_interface_name << "!");
       PRINT_TRACE_EXIT
       return false;
     }
 
-    int starvation_counter = 0;
-    while(ros::ok())
     {
-      uint32_t buffer_sequence_id = *m_buffer_sequence_id_ptr;
-      bool even = isEven(buffer_sequence_id);
-      unsigned char* data_ptr = even? m_even_data_ptr : m_odd_data_ptr;
-      uint32_t* length_ptr = even? m_even_length_ptr : m_odd_length_ptr;
-      try
+      boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> directory_lock(m_directory_ptr->mutex);
+      FieldDirectoryEntry* entry = m_directory_ptr->find(m_field_name);
+      if(entry == NULL)
+      {
+        ROS_ID_WARN_STREAM("Tried to retire field " << m_field_name << ", which isn't listed in " << m_interface_name << "!");
+        PRINT_TRACE_EXIT
+        return false;
+      }
+      std::string group = entry->group;
+      if(entry->header != 0)
       {
-        ros::serialization::IStream istream(data_ptr, *length_ptr);
-        ros::serialization::deserialize(istream, data);
-        if(buffer_sequence_id == *m_buffer_sequence_id_ptr) //no one wrote to the buffer while we were trying to read it
+        FieldHeader* header = (FieldHeader*) segment->get_address_from_handle(entry->header);
+        header->retired.store(1, boost::memory_order_seq_cst);
+        futexWakeAll(&header->sequence); //so blocked readers notice now rather than at their next timeout
+        if(header->watchers.load(boost::memory_order_relaxed) != 0)
         {
-          m_last_read_buffer_sequence_id = buffer_sequence_id;
-          if(starvation_counter > 2)
-          {
-            ROS_ID_WARN_STREAM(starvation_counter << " starvations while getting data from field " << m_field_name);
-          }
-
-          PRINT_TRACE_EXIT
-          return true;
+          ringWatchers(header);
         }
-        else
+        if(header->attached == 0) //created, but nobody ever connected
         {
-          starvation_counter++;
+          destroyField(header);
         }
       }
-      catch(std::exception& ex) //catch std::string issues that happen during the copy
+      m_directory_ptr->remove(entry);
+      //still under the lock, so a field joining the group either is listed already and keeps the segment, or comes
+      //after the segment is flagged and makes a new one
+      if(!group.empty() && !m_directory_ptr->groupInUse(group))
       {
-        std::cerr << "Exception " << ex.what() << " occurred while getting data from field " << m_field_name << std::endl;
+        ROS_ID_INFO_STREAM("Field " << m_field_name << " was the last one in group " << group << ", destroying its segment.");
+        destroyGroupSegment(groupSegmentName(m_interface_name, group));
       }
-
-      //boost::this_thread::interruption_point();
     }
+    disconnect(); //the segment stays mapped until the watchdog lets go of it, a second after it notices
 
+    ROS_ID_INFO_STREAM("Retired field " << m_field_name << ".");
     PRINT_TRACE_EXIT
-    return false;
+    return true;
   }
 
+  //copies the slot holding sequence_id into m_read_buffer (or straight into data for raw layout types), returns false
+  //if the slot didn't hold a complete copy of that message
   template<typename T>
-  bool SharedMemoryTransport<T>::setData(T& data)
+  bool SharedMemoryTransport<T>::copySlot(uint32_t sequence_id, T& data)
   {
-    PRINT_TRACE_ENTER
-    TEST_CONNECTED
-
-    unsigned long oserial_size = ros::serialization::serializationLength(data);
-
-    //todo make sure we resize if we don't fit!
+    uint32_t slot = sequence_id % m_num_slots;
+    uint32_t tag = m_slot_states_ptr[slot].tag.load(boost::memory_order_acquire);
+    if(tag != 2 * sequence_id) //not written yet, being rewritten, or already recycled
+    {
+      return false;
+    }
+    if(m_generation_ptr->load(boost::memory_order_relaxed) != m_slot_buffer_ptr->generation) //ordered by the acquire above
+    {
+      resolveSlotBuffer(); //the message may live in a newer generation, so try again there
+      return false;
+    }
 
-    unsigned char* data_ptr;
-    uint32_t* length_ptr;
-    uint32_t buffer_sequence_id = *m_buffer_sequence_id_ptr;
-    if(isEven(buffer_sequence_id))
+    if(MessageCodec<T>::rawLayout()) //a torn copy of plain old data is harmless, since we throw it away below
     {
-      data_ptr = m_odd_data_ptr;
-      length_ptr = m_odd_length_ptr;
+      MessageCodec<T>::deserialize(m_ring_data_ptr + slot * m_slot_size, sizeof(T), data); //a single memcpy
     }
     else
     {
-      data_ptr = m_even_data_ptr;
-      length_ptr = m_even_length_ptr;
+      uint32_t length = m_slot_states_ptr[slot].length.load(boost::memory_order_relaxed);
+      if(length > m_slot_size) //a torn length, or one meant for a newer generation
+      {
+        return false;
+      }
+      memcpy(&m_read_buffer[0], m_ring_data_ptr + slot * m_slot_size, length);
+      m_read_length = length;
     }
-    ros::serialization::OStream ostream(data_ptr, oserial_size);
-    ros::serialization::serialize(ostream, data);
+    m_read_delivered_locally = (m_slot_states_ptr[slot].delivered_by.load(boost::memory_order_relaxed) == m_pid);
+    m_read_publish_ns = m_slot_states_ptr[slot].publish_ns.load(boost::memory_order_relaxed);
 
-    *length_ptr = oserial_size;
+    boost::atomic_thread_fence(boost::memory_order_acquire); //keep the copy above from sinking below the re-check
+    return m_slot_states_ptr[slot].tag.load(boost::memory_order_relaxed) == tag; //no one wrote to the slot while we were copying it
+  }
 
-//    if(!m_already_set_valid)
-//    {
-    *m_invalid_ptr = false;
-//      m_already_set_valid = true;
-//    }
-    *m_buffer_sequence_id_ptr = buffer_sequence_id + 1;
-    m_condition_ptr->notify_all();
+  template<typename T>
+  bool SharedMemoryTransport<T>::deserializeReadBuffer(T& data)
+  {
+    if(MessageCodec<T>::rawLayout()) //copySlot already put it in place
+    {
+      return true;
+    }
 
-    PRINT_TRACE_EXIT
-    return true;
+    try
+    {
+      MessageCodec<T>::deserialize(&m_read_buffer[0], m_read_length, data);
+      describeMessage(data, m_last_read_buffer_sequence_id, m_field_header_ptr);
+      return true;
+    }
+    catch(std::exception& ex) //the copy was validated, so this means the publisher and subscriber disagree about the type
+    {
+      ROS_ID_ERROR_THROTTLED_STREAM("Exception " << ex.what() << " occurred while deserializing data from field " << m_field_name);
+      return false;
+    }
   }
 
   template<typename T>
-  bool SharedMemoryTransport<T>::hasData()
+  bool SharedMemoryTransport<T>::getData(T& data)
   {
     PRINT_TRACE_ENTER
-    bool has_data = !(*m_invalid_ptr);
-    m_already_read_valid = has_data;
+    if(!checkConnection() || (!m_already_read_valid && !hasData()))
+    {
+      PRINT_TRACE_EXIT
+      return false;
+    }
+
+    int starvation_counter = 0;
+    while(ros::ok())
+    {
+      uint32_t buffer_sequence_id = m_buffer_sequence_id_ptr->load(boost::memory_order_acquire);
+      if(copySlot(buffer_sequence_id, data))
+      {
+        uint32_t unread = buffer_sequence_id - m_last_read_buffer_sequence_id;
+        m_unreported_skipped += (unread > 1)? unread - 1 : 0; //nothing if we read this one before
+        m_last_read_buffer_sequence_id = buffer_sequence_id;
+        markRead(buffer_sequence_id);
+        if(m_skip_local_deliveries && m_read_delivered_locally) //we have it already
+        {
+          PRINT_TRACE_EXIT
+          return false;
+        }
+        m_last_read_skipped = m_unreported_skipped;
+        m_unreported_skipped = 0;
+        if(starvation_counter > 2)
+        {
+          ROS_ID_WARN_STREAM(starvation_counter << " starvations while getting data from field " << m_field_name);
+        }
+
+        PRINT_TRACE_EXIT
+        return deserializeReadBuffer(data);
+      }
+      starvation_counter++;
+      countReadRetry();
+
+      //boost::this_thread::interruption_point();
+    }
+
     PRINT_TRACE_EXIT
-    return has_data;
+    return false;
   }
 
   template<typename T>
-  bool SharedMemoryTransport<T>::awaitNewDataPolled(T& data, double timeout)
+  bool SharedMemoryTransport<T>::getNextData(T& data)
   {
     PRINT_TRACE_ENTER
-    TEST_CONNECTED
-
-    if(timeout == 0)
+    if(!checkConnection() || (!m_already_read_valid && !hasData()))
     {
       PRINT_TRACE_EXIT
-      return getData(data);
+      return false;
     }
 
-    if(!m_already_read_valid)
+    int starvation_counter = 0;
+    while(ros::ok())
     {
-      while(ros::ok() && (*m_invalid_ptr)) //wait for the field to at least have something
+      uint32_t buffer_sequence_id = m_buffer_sequence_id_ptr->load(boost::memory_order_acquire);
+      uint32_t unread = buffer_sequence_id - m_last_read_buffer_sequence_id;
+      if(unread == 0)
       {
-        CATCH_SHUTDOWN_SIGNAL
-        ROS_ID_WARN_THROTTLED_STREAM("Waiting for field " << m_field_name << " to become valid.");
-        //boost::this_thread::interruption_point();
+        PRINT_TRACE_EXIT
+        return false;
       }
-      m_already_read_valid = true;
-    }
 
-    if(timeout < 0)
-    {
-      while(ros::ok() && (m_last_read_buffer_sequence_id == *m_buffer_sequence_id_ptr)) //wait for the selector to change
+      //only queue_size slots are safe to read, the remaining one may be under construction
+      uint32_t next_sequence_id = m_last_read_buffer_sequence_id + 1;
+      if(unread > m_num_slots - 1)
       {
-        CATCH_SHUTDOWN_SIGNAL
+        next_sequence_id = buffer_sequence_id - (m_num_slots - 1) + 1;
       }
-    }
-    else
-    {
-      boost::posix_time::ptime timeout_time = boost::get_system_time() + boost::posix_time::milliseconds(timeout);
-      while(ros::ok() && (m_last_read_buffer_sequence_id == *m_buffer_sequence_id_ptr)) //wait for the selector to change
+
+      if(copySlot(next_sequence_id, data))
       {
-        CATCH_SHUTDOWN_SIGNAL
-        if(timeout < 0)
+        uint32_t dropped = next_sequence_id - m_last_read_buffer_sequence_id - 1;
+        if(dropped > 0)
         {
-//          ROS_ID_DEBUG_THROTTLED_STREAM("Waiting for new data in field " << m_field_name);
+          m_unreported_skipped += dropped;
+          m_dropped_messages += dropped;
+          countOverruns(dropped);
+          ROS_ID_WARN_THROTTLED_STREAM("Fell behind by " << dropped << " messages in field " << m_field_name << " (" << m_dropped_messages << " dropped in total)");
         }
-        else if(boost::get_system_time() < timeout_time)
+        m_last_read_buffer_sequence_id = next_sequence_id;
+        markRead(next_sequence_id);
+        if(m_skip_local_deliveries && m_read_delivered_locally) //we have it already
         {
-//          ROS_ID_DEBUG_THROTTLED_STREAM("Waiting for new data in field " << m_field_name << " with timeout " << timeout);
+          continue;
         }
-        else
+        m_last_read_skipped = m_unreported_skipped;
+        m_unreported_skipped = 0;
+        if(starvation_counter > 2)
         {
-          ROS_ID_INFO_STREAM("Timed out while waiting for new data in field " << m_field_name << " with timeout " << timeout << "!");
-          PRINT_TRACE_EXIT
-          return false;
+          ROS_ID_WARN_STREAM(starvation_counter << " starvations while getting data from field " << m_field_name);
         }
-        //boost::this_thread::interruption_point();
+
+        PRINT_TRACE_EXIT
+        return deserializeReadBuffer(data);
       }
+      starvation_counter++;
+      countReadRetry();
     }
 
     PRINT_TRACE_EXIT
-    return getData(data);
+    return false;
   }
 
   template<typename T>
-  bool SharedMemoryTransport<T>::awaitNewData(T& data, double timeout)
+  bool SharedMemoryTransport<T>::setData(const T& data, bool delivered_locally, std::vector<unsigned char>* copy)
   {
     PRINT_TRACE_ENTER
     TEST_CONNECTED
 
-    if(timeout == 0)
+    uint32_t oserial_size = MessageCodec<T>::serializedLength(data);
+    unsigned char* data_ptr = beginWrite(oserial_size);
+    if(data_ptr == NULL)
     {
       PRINT_TRACE_EXIT
-      return getData(data);
+      return false;
     }
-    else if(timeout < 0)
+
+    MessageCodec<T>::serialize(data_ptr, oserial_size, data);
+    if(copy != NULL) //once we commit, the next publisher may overwrite the slot
     {
-      boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*m_condition_mutex_ptr);
-      m_condition_ptr->wait(lock);
-      lock.unlock();
-      return getData(data);
+      copy->assign(data_ptr, data_ptr + oserial_size);
     }
-    else
+
+    PRINT_TRACE_EXIT
+    return commitSlot(oserial_size, delivered_locally);
+  }
+
+  template<typename T>
+  unsigned char* SharedMemoryTransport<T>::beginWrite(uint32_t length)
+  {
+    PRINT_TRACE_ENTER
+    if(!m_connected)
     {
-      boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*m_condition_mutex_ptr);
-      boost::posix_time::ptime timeout_time = boost::get_system_time() + boost::posix_time::milliseconds(timeout);
-      if(!m_condition_ptr->timed_wait(lock, timeout_time))
+      ROS_ID_ERROR_STREAM("Tried to call " << __func__ << " on an unconnected shared memory transport!");
+      return NULL;
+    }
+    if(!checkConnection()) //the next publish connects to whatever replaces the field, if anything
+    {
+      PRINT_TRACE_EXIT
+      return NULL;
+    }
+
+    if(m_write_ptr != NULL) //a second beginWrite without a commit just hands back the same slot
+    {
+      if(length > m_slot_size)
       {
+        ROS_ID_ERROR_STREAM("Can't grow the slots of field " << m_field_name << " in the middle of a write!");
         PRINT_TRACE_EXIT
+        return NULL;
+      }
+      PRINT_TRACE_EXIT
+      return m_write_ptr;
+    }
+
+    if(!lockWriter())
+    {
+      PRINT_TRACE_EXIT
+      return NULL;
+    }
+    if(m_generation_ptr->load(boost::memory_order_relaxed) != m_slot_buffer_ptr->generation) //another publisher grew the slots
+    {
+      resolveSlotBuffer();
+    }
+    if(length > m_slot_size && !growSlots(length))
+    {
+      unlockWriter();
+      PRINT_TRACE_EXIT
+      return NULL;
+    }
+
+    m_write_sequence_id = m_buffer_sequence_id_ptr->load(boost::memory_order_relaxed) + 1; //we hold the writer lock, so nobody else is writing
+    uint32_t slot = m_write_sequence_id % m_num_slots;
+    m_slot_states_ptr[slot].tag.store(2 * m_write_sequence_id - 1, boost::memory_order_relaxed); //odd: write in progress
+    boost::atomic_thread_fence(boost::memory_order_release); //readers must see the odd tag before any of the new bytes
+    m_write_ptr = m_ring_data_ptr + slot * m_slot_size;
+
+    PRINT_TRACE_EXIT
+    return m_write_ptr;
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::commitWrite(uint32_t length)
+  {
+    return commitSlot(length, false);
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::commitSlot(uint32_t length, bool delivered_locally)
+  {
+    PRINT_TRACE_ENTER
+    if(m_write_ptr == NULL)
+    {
+      ROS_ID_ERROR_STREAM("Tried to commit a write to field " << m_field_name << " that was never started!");
+      PRINT_TRACE_EXIT
+      return false;
+    }
+
+    uint32_t slot = m_write_sequence_id % m_num_slots;
+    if(!MessageCodec<T>::rawLayout())
+    {
+      m_slot_states_ptr[slot].length.store(length, boost::memory_order_relaxed);
+    }
+    m_slot_states_ptr[slot].delivered_by.store(delivered_locally? m_pid : 0, boost::memory_order_relaxed);
+    m_slot_states_ptr[slot].publish_ns.store(monotonicNanoseconds(), boost::memory_order_relaxed);
+    m_field_header_ptr->bytes_published.store(m_field_header_ptr->bytes_published.load(boost::memory_order_relaxed) + length, boost::memory_order_relaxed);
+    m_slot_states_ptr[slot].tag.store(2 * m_write_sequence_id, boost::memory_order_release); //even: complete
+    m_buffer_sequence_id_ptr->store(m_write_sequence_id, boost::memory_order_release);
+    m_write_ptr = NULL;
+    unlockWriter();
+    boost::atomic_thread_fence(boost::memory_order_seq_cst); //pairs with the waiter's increment, see awaitNewData
+    if(m_waiter_count_ptr->load(boost::memory_order_relaxed) != 0)
+    {
+      futexWakeAll(m_buffer_sequence_id_ptr);
+    }
+    if(m_watcher_count_ptr->load(boost::memory_order_relaxed) != 0) //same protocol as above, one level up
+    {
+      ringWatchers(m_field_header_ptr);
+    }
+
+    PRINT_TRACE_EXIT
+    return true;
+  }
+
+  template<typename T>
+  uint32_t SharedMemoryTransport<T>::getLastWriteSequence()
+  {
+    return m_write_sequence_id;
+  }
+
+  //copies the serialized bytes of any message still in the queue, not just the latest or the next unread one
+  template<typename T>
+  bool SharedMemoryTransport<T>::copySerializedData(uint32_t sequence_id, std::vector<unsigned char>& buffer)
+  {
+    TEST_CONNECTED
+    if(!checkConnection())
+    {
+      return false;
+    }
+    while(true)
+    {
+      uint32_t slot = sequence_id % m_num_slots;
+      uint32_t tag = m_slot_states_ptr[slot].tag.load(boost::memory_order_acquire);
+      if(tag != 2 * sequence_id)
+      {
         return false;
       }
-      lock.unlock();
-      return getData(data);
+      if(m_generation_ptr->load(boost::memory_order_relaxed) != m_slot_buffer_ptr->generation)
+      {
+        resolveSlotBuffer();
+        continue;
+      }
+
+      uint32_t length = MessageCodec<T>::rawLayout()? sizeof(T) : m_slot_states_ptr[slot].length.load(boost::memory_order_relaxed);
+      if(length > m_slot_size)
+      {
+        return false;
+      }
+      buffer.resize(length);
+      if(length != 0)
+      {
+        memcpy(&buffer[0], m_ring_data_ptr + slot * m_slot_size, length);
+      }
+
+      boost::atomic_thread_fence(boost::memory_order_acquire);
+      return m_slot_states_ptr[slot].tag.load(boost::memory_order_relaxed) == tag;
     }
   }
 
+  //Publishers on a field write one at a time, so readers never see a mix of two messages. The header's writer word is a
+  //spin lock holding the pid of the publisher that's writing: a publisher that died while holding it is replaced once
+  //the field has been stuck for SM_STALLED_WRITER_NS (processes in other pid namespaces look dead, but they don't
+  //stay stuck). A write lasts one serialization, so waiting is a short spin followed by yields. Returns false if the
+  //interface shut down while we were waiting.
   template<typename T>
-  std::string SharedMemoryTransport<T>::getFieldName()
+  bool SharedMemoryTransport<T>::lockWriter()
   {
-    return m_field_name;
+    uint32_t spins = 0;
+    uint32_t stalled_holder = 0;
+    uint32_t stalled_sequence_id = 0;
+    uint64_t stalled_since_ns = 0;
+    while(true)
+    {
+      uint32_t holder = m_field_header_ptr->writer.load(boost::memory_order_relaxed);
+      if(holder == 0 && m_field_header_ptr->writer.compare_exchange_weak(holder, m_pid, boost::memory_order_acquire))
+      {
+        return true;
+      }
+      if(spins == 0 && holder != 0)
+      {
+        m_field_header_ptr->writer_waits.fetch_add(1, boost::memory_order_relaxed);
+      }
+
+      if(++spins < SM_WRITER_SPINS)
+      {
+        cpuRelax();
+        continue;
+      }
+      sched_yield();
+      if(spins % SM_WRITER_SPINS == 0)
+      {
+        CATCH_SHUTDOWN_SIGNAL
+        uint32_t sequence_id = m_buffer_sequence_id_ptr->load(boost::memory_order_relaxed);
+        uint64_t now = monotonicNanoseconds();
+        if(holder == 0 || holder != stalled_holder || sequence_id != stalled_sequence_id)
+        {
+          stalled_holder = holder;
+          stalled_sequence_id = sequence_id;
+          stalled_since_ns = now;
+        }
+        else if(now - stalled_since_ns > SM_STALLED_WRITER_NS && !processAlive(holder) && m_field_header_ptr->writer.compare_exchange_strong(holder, m_pid, boost::memory_order_acquire))
+        {
+          //whatever it left half written is in the slot we're about to write again
+          ROS_ID_WARN_STREAM("Publisher " << stalled_holder << " died while writing to field " << m_field_name << ", taking over.");
+          return true;
+        }
+      }
+    }
+  }
+
+  template<typename T>
+  void SharedMemoryTransport<T>::unlockWriter()
+  {
+    m_field_header_ptr->writer.store(0, boost::memory_order_release); //publishes everything we wrote to the next publisher
+  }
+
+  template<typename T>
+  void SharedMemoryTransport<T>::registerReader()
+  {
+    if(m_registered_reader)
+    {
+      return;
+    }
+    m_registered_reader = true;
+    if(m_connected) //otherwise connect takes care of it
+    {
+      claimReaderEntry();
+    }
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::hasReaders()
+  {
+    if(!initialized() || !m_connected)
+    {
+      return false;
+    }
+    return m_field_header_ptr->readers.load(boost::memory_order_relaxed) != 0;
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::hasReadersBesides(uint32_t count)
+  {
+    if(!initialized() || !m_connected)
+    {
+      return false;
+    }
+    return m_field_header_ptr->readers.load(boost::memory_order_relaxed) > count;
+  }
+
+  //Subscribers that are handed our process' messages directly set this, so they don't get those twice. Publishers mark
+  //the messages they delivered that way in the slot, see IntraProcessChannel.
+  template<typename T>
+  void SharedMemoryTransport<T>::skipLocalDeliveries()
+  {
+    m_skip_local_deliveries = true;
+  }
+
+  //Counts the field's registered subscribers, first dropping the ones whose process is gone and that haven't checked in
+  //for SM_STALE_READER_NS. Subscribers in another pid namespace look dead, but they keep checking in while they're
+  //blocked or reading, so only the heartbeat and the pid together are trusted.
+  template<typename T>
+  uint32_t SharedMemoryTransport<T>::getNumReaders()
+  {
+    if(!initialized() || !m_connected)
+    {
+      return 0;
+    }
+    ReaderEntry* table = m_field_header_ptr->reader_table.get();
+    uint64_t now = coarseMonotonicNanoseconds();
+    uint32_t num_readers = 0;
+    for(unsigned int i = 0; i < SM_MAX_READERS; i++)
+    {
+      uint32_t pid = table[i].pid.load(boost::memory_order_acquire);
+      if(pid == 0)
+      {
+        continue;
+      }
+      uint64_t heartbeat_ns = table[i].heartbeat_ns.load(boost::memory_order_relaxed);
+      if(now > heartbeat_ns + SM_STALE_READER_NS && !processAlive(pid) && table[i].pid.compare_exchange_strong(pid, 0, boost::memory_order_relaxed))
+      {
+        m_field_header_ptr->readers.fetch_sub(1, boost::memory_order_relaxed);
+        ROS_ID_INFO_STREAM("Dropped subscriber " << pid << " from field " << m_field_name << ", its process is gone.");
+        continue;
+      }
+      num_readers++;
+    }
+    return num_readers;
+  }
+
+  //Takes a free entry in the field's reader table. A full table isn't fatal, publishers just won't count us.
+  template<typename T>
+  void SharedMemoryTransport<T>::claimReaderEntry()
+  {
+    ReaderEntry* table = m_field_header_ptr->reader_table.get();
+    if(m_reader_entry_ptr >= table && m_reader_entry_ptr < table + SM_MAX_READERS) //reconnecting to the same field
+    {
+      return;
+    }
+    m_reader_entry_ptr = NULL;
+    for(unsigned int i = 0; i < SM_MAX_READERS; i++)
+    {
+      uint32_t free_pid = 0;
+      if(table[i].pid.load(boost::memory_order_relaxed) == 0 && table[i].pid.compare_exchange_strong(free_pid, m_pid, boost::memory_order_acquire))
+      {
+        table[i].id.store(nextReaderId(), boost::memory_order_relaxed);
+        table[i].last_read_sequence.store(m_last_read_buffer_sequence_id, boost::memory_order_relaxed);
+        table[i].heartbeat_ns.store(coarseMonotonicNanoseconds(), boost::memory_order_relaxed);
+        m_field_header_ptr->readers.fetch_add(1, boost::memory_order_relaxed);
+        m_reader_entry_ptr = &table[i];
+        return;
+      }
+    }
+    ROS_ID_WARN_STREAM("The reader table of field " << m_field_name << " is full (" << SM_MAX_READERS << " subscribers), publishers won't know about us!");
+  }
+
+  template<typename T>
+  void SharedMemoryTransport<T>::releaseReaderEntry()
+  {
+    uint32_t pid = m_pid;
+    if(m_reader_entry_ptr->pid.compare_exchange_strong(pid, 0, boost::memory_order_release)) //unless someone took us for dead
+    {
+      m_field_header_ptr->readers.fetch_sub(1, boost::memory_order_relaxed);
+    }
+    m_reader_entry_ptr = NULL;
+  }
+
+  template<typename T>
+  void SharedMemoryTransport<T>::markRead(uint32_t sequence_id)
+  {
+    if(m_reader_entry_ptr != NULL)
+    {
+      m_reader_entry_ptr->last_read_sequence.store(sequence_id, boost::memory_order_relaxed);
+      m_reader_entry_ptr->heartbeat_ns.store(coarseMonotonicNanoseconds(), boost::memory_order_relaxed);
+      m_reader_entry_ptr->reads.store(m_reader_entry_ptr->reads.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+    }
+  }
+
+  template<typename T>
+  void SharedMemoryTransport<T>::countReadRetry()
+  {
+    if(m_reader_entry_ptr != NULL)
+    {
+      m_reader_entry_ptr->read_retries.store(m_reader_entry_ptr->read_retries.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+    }
+  }
+
+  template<typename T>
+  void SharedMemoryTransport<T>::countOverruns(uint32_t count)
+  {
+    if(m_reader_entry_ptr != NULL)
+    {
+      m_reader_entry_ptr->overruns.store(m_reader_entry_ptr->overruns.load(boost::memory_order_relaxed) + count, boost::memory_order_relaxed);
+    }
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::borrowNextData(const unsigned char*& data, uint32_t& length)
+  {
+    PRINT_TRACE_ENTER
+    if(!checkConnection() || (!m_already_read_valid && !hasData()))
+    {
+      PRINT_TRACE_EXIT
+      return false;
+    }
+
+    while(ros::ok())
+    {
+      uint32_t buffer_sequence_id = m_buffer_sequence_id_ptr->load(boost::memory_order_acquire);
+      uint32_t unread = buffer_sequence_id - m_last_read_buffer_sequence_id;
+      if(unread == 0)
+      {
+        PRINT_TRACE_EXIT
+        return false;
+      }
+
+      uint32_t next_sequence_id = m_last_read_buffer_sequence_id + 1;
+      if(unread > m_num_slots - 1)
+      {
+        next_sequence_id = buffer_sequence_id - (m_num_slots - 1) + 1;
+      }
+
+      uint32_t slot = next_sequence_id % m_num_slots;
+      if(m_slot_states_ptr[slot].tag.load(boost::memory_order_acquire) == 2 * next_sequence_id)
+      {
+        if(m_generation_ptr->load(boost::memory_order_relaxed) != m_slot_buffer_ptr->generation)
+        {
+          resolveSlotBuffer();
+          continue;
+        }
+
+        length = m_slot_states_ptr[slot].length.load(boost::memory_order_relaxed);
+        if(length <= m_slot_size)
+        {
+          //only count what we skipped once we know we're not going to retry, as in getNextData
+          uint32_t dropped = next_sequence_id - m_last_read_buffer_sequence_id - 1;
+          if(dropped > 0)
+          {
+            m_dropped_messages += dropped;
+            countOverruns(dropped);
+            ROS_ID_WARN_THROTTLED_STREAM("Fell behind by " << dropped << " messages in field " << m_field_name << " (" << m_dropped_messages << " dropped in total)");
+          }
+          m_last_read_skipped = m_unreported_skipped + dropped;
+          m_unreported_skipped = 0;
+          data = m_ring_data_ptr + slot * m_slot_size;
+          m_borrowed_sequence_id = next_sequence_id;
+          m_last_read_buffer_sequence_id = next_sequence_id;
+          markRead(next_sequence_id);
+          PRINT_TRACE_EXIT
+          return true;
+        }
+      }
+      countReadRetry();
+    }
+
+    PRINT_TRACE_EXIT
+    return false;
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::releaseBorrowedData()
+  {
+    boost::atomic_thread_fence(boost::memory_order_acquire); //everything the caller read happens before the re-check
+    uint32_t slot = m_borrowed_sequence_id % m_num_slots;
+    return m_slot_states_ptr[slot].tag.load(boost::memory_order_relaxed) == 2 * m_borrowed_sequence_id;
+  }
+
+  template<typename T>
+  void SharedMemoryTransport<T>::unlistField(FieldDirectoryEntry* entry)
+  {
+    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> directory_lock(m_directory_ptr->mutex);
+    m_directory_ptr->remove(entry);
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::locateField()
+  {
+    std::string group;
+    {
+      boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> directory_lock(m_directory_ptr->mutex);
+      FieldDirectoryEntry* entry = m_directory_ptr->find(m_field_name);
+      if(entry == NULL)
+      {
+        return false;
+      }
+      group = entry->group;
+    }
+
+    if(group.empty())
+    {
+      m_segment_handle = m_interface_handle;
+    }
+    else if(m_segment_handle->getInterfaceName() != groupSegmentName(m_interface_name, group) || m_segment_handle->shutdownSignaled())
+    {
+      boost::shared_ptr<SegmentHandle> handle = SegmentRegistry::acquire(groupSegmentName(m_interface_name, group));
+      if(!handle) //listed, but its segment isn't there yet
+      {
+        return false;
+      }
+      m_segment_handle = handle;
+    }
+    segment = m_segment_handle->segment();
+    return true;
+  }
+
+  template<typename T>
+  FieldHeader* SharedMemoryTransport<T>::findFieldHeader(bool attach)
+  {
+    if(!locateField())
+    {
+      return NULL;
+    }
+    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> directory_lock(m_directory_ptr->mutex);
+    FieldDirectoryEntry* entry = m_directory_ptr->find(m_field_name);
+    if(entry == NULL || entry->header == 0 || segment == NULL)
+    {
+      return NULL;
+    }
+    std::string segment_name = (entry->group[0] == '\0')? m_interface_name : groupSegmentName(m_interface_name, entry->group);
+    if(m_segment_handle->getInterfaceName() != segment_name) //retired and recreated elsewhere since locateField
+    {
+      return NULL;
+    }
+    FieldHeader* header = (FieldHeader*) segment->get_address_from_handle(entry->header);
+    if(header->ready.load(boost::memory_order_acquire) == 0)
+    {
+      return NULL;
+    }
+    if(attach)
+    {
+      header->attached++;
+    }
+    return header;
+  }
+
+  //Lets go of the field: the writer lock, our reader entry and slot buffer, and the field itself. The last transport to
+  //let go of a retired field frees it, under the directory mutex so nobody can attach in the meantime. If the segment
+  //is gone there's nothing left to let go of.
+  template<typename T>
+  void SharedMemoryTransport<T>::disconnect()
+  {
+    if(!m_connected)
+    {
+      return;
+    }
+    if(initialized())
+    {
+      if(m_write_ptr != NULL) //an unpublished loan, let the other publishers write
+      {
+        unlockWriter();
+      }
+      if(m_reader_entry_ptr != NULL)
+      {
+        releaseReaderEntry();
+      }
+      if(m_watch_entry_ptr != NULL)
+      {
+        releaseWatchEntry();
+      }
+      boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> directory_lock(m_directory_ptr->mutex);
+      releaseSlotBuffer(m_slot_buffer_ptr);
+      if(--m_field_header_ptr->attached == 0 && m_field_header_ptr->retired.load(boost::memory_order_relaxed) != 0)
+      {
+        destroyField(m_field_header_ptr);
+      }
+    }
+    m_write_ptr = NULL;
+    m_reader_entry_ptr = NULL;
+    m_watch_entry_ptr = NULL;
+    m_slot_buffer_ptr = NULL;
+    m_field_header_ptr = NULL;
+    m_already_read_valid = false;
+    m_connected = false;
+    m_segment_handle = m_interface_handle;
+    segment = m_segment_handle->segment();
+  }
+
+  //Returns false once the field we're connected to has been retired or its segment shut down, and disconnects us, so
+  //nothing touches the field's memory anymore and the next connect finds whatever replaces it. Call it before reading
+  //or writing the field; after that the field stays valid until we disconnect.
+  template<typename T>
+  bool SharedMemoryTransport<T>::checkConnection()
+  {
+    if(!m_connected)
+    {
+      return false;
+    }
+    if(initialized() && m_field_header_ptr->retired.load(boost::memory_order_relaxed) == 0)
+    {
+      return true;
+    }
+    ROS_ID_INFO_STREAM("Field " << m_field_name << " was retired or shut down, disconnecting from it.");
+    disconnect();
+    return false;
+  }
+
+  //frees everything createField allocated for a retired field. Only call it with the directory mutex held, once nobody
+  //is attached anymore, which also means every superseded slot buffer has been freed already
+  template<typename T>
+  void SharedMemoryTransport<T>::destroyField(FieldHeader* header)
+  {
+    ROS_ID_DEBUG_STREAM("Reclaiming the memory of retired field " << m_field_name);
+    SlotBuffer* buffer = header->buffer.get();
+    if(buffer != NULL)
+    {
+      segment->deallocate(buffer->data.get());
+      segment->destroy_ptr(buffer);
+    }
+    segment->deallocate(header->slots.get());
+    segment->deallocate(header->reader_table.get());
+    segment->deallocate(header->latency.get());
+    header->~FieldHeader();
+    segment->deallocate(header);
+  }
+
+  //the new buffer isn't referenced by anyone yet. Returns NULL if the segment is out of space
+  template<typename T>
+  SlotBuffer* SharedMemoryTransport<T>::createSlotBuffer(uint32_t generation, unsigned long slot_size)
+  {
+    SlotBuffer* buffer = NULL;
+    try
+    {
+      buffer = segment->construct<SlotBuffer>(boost::interprocess::anonymous_instance)(generation, slot_size);
+      buffer->data = (unsigned char*) segment->allocate_aligned(slot_size * m_num_slots, SM_CACHE_LINE_SIZE);
+    }
+    catch(boost::interprocess::interprocess_exception &ex)
+    {
+      ROS_ID_ERROR_STREAM("Couldn't allocate " << m_num_slots << " slots of " << slot_size << " bytes for field " << m_field_name << ": " << ex.what());
+      if(buffer != NULL)
+      {
+        segment->destroy_ptr(buffer);
+      }
+      return NULL;
+    }
+    return buffer;
+  }
+
+  //switches to the current slot buffer generation, dropping our reference to the old one
+  template<typename T>
+  void SharedMemoryTransport<T>::resolveSlotBuffer()
+  {
+    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*m_generation_mutex_ptr);
+    uint32_t generation = m_generation_ptr->load(boost::memory_order_relaxed);
+    if(m_slot_buffer_ptr != NULL && m_slot_buffer_ptr->generation == generation)
+    {
+      return;
+    }
+
+    SlotBuffer* old_buffer = m_slot_buffer_ptr;
+    m_slot_buffer_ptr = m_field_header_ptr->buffer.get();
+    m_slot_buffer_ptr->references++;
+    m_ring_data_ptr = m_slot_buffer_ptr->data.get();
+    m_slot_size = m_slot_buffer_ptr->slot_size;
+    if(!MessageCodec<T>::rawLayout())
+    {
+      m_read_buffer.resize(m_slot_size);
+    }
+    lock.unlock();
+
+    if(old_buffer != NULL)
+    {
+      releaseSlotBuffer(old_buffer);
+      prefault(); //connect takes care of the first generation
+    }
+  }
+
+  //touches (and maybe locks) everything the data path is going to use, see PrefaultPolicy
+  template<typename T>
+  void SharedMemoryTransport<T>::prefault()
+  {
+    if(m_prefault_policy.scope == PrefaultPolicy::NONE)
+    {
+      return;
+    }
+
+    if(m_prefault_policy.scope == PrefaultPolicy::SEGMENT) //new generations are allocated inside it, so once is enough
+    {
+      m_segment_handle->prefault(m_prefault_policy.lock);
+    }
+    else
+    {
+      prefaultMemory(m_field_header_ptr, sizeof(FieldHeader), m_prefault_policy.lock);
+      prefaultMemory(m_slot_states_ptr, m_num_slots * sizeof(SlotState), m_prefault_policy.lock);
+      prefaultMemory(m_ring_data_ptr, m_num_slots * m_slot_size, m_prefault_policy.lock);
+    }
+    if(!m_read_buffer.empty())
+    {
+      prefaultMemory(&m_read_buffer[0], m_read_buffer.size(), m_prefault_policy.lock);
+    }
+  }
+
+  //the last transport to let go of a superseded generation destroys it
+  template<typename T>
+  void SharedMemoryTransport<T>::releaseSlotBuffer(SlotBuffer* buffer)
+  {
+    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*m_generation_mutex_ptr);
+    buffer->references--;
+    if(buffer->references == 0 && buffer->generation != m_generation_ptr->load(boost::memory_order_relaxed))
+    {
+      ROS_ID_DEBUG_STREAM("Reclaiming generation " << buffer->generation << " of field " << m_field_name);
+      segment->deallocate(buffer->data.get());
+      segment->destroy_ptr(buffer);
+    }
+  }
+
+  //allocates a new generation with slots big enough for length and carries the queued messages over to it
+  template<typename T>
+  bool SharedMemoryTransport<T>::growSlots(uint32_t length)
+  {
+    if(MessageCodec<T>::rawLayout())
+    {
+      ROS_ID_ERROR_STREAM("Fixed-size field " << m_field_name << " got a message of " << length << " bytes instead of " << sizeof(T) << "!");
+      return false;
+    }
+
+    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*m_generation_mutex_ptr);
+    uint32_t generation = m_slot_buffer_ptr->generation + 1;
+    unsigned long slot_size = roundUpToCacheLine(std::max((unsigned long) length, 2 * m_slot_size)); //double, so a slowly growing message doesn't realloc every time
+    ROS_ID_INFO_STREAM("Growing the slots of field " << m_field_name << " from " << m_slot_size << " to " << slot_size << " bytes (generation " << generation << ")");
+
+    SlotBuffer* new_buffer = createSlotBuffer(generation, slot_size);
+    if(new_buffer == NULL)
+    {
+      return false;
+    }
+
+    //readers may still be working through the queue, so every slot has to be readable in the new generation too
+    unsigned char* new_data_ptr = new_buffer->data.get();
+    for(uint32_t slot = 0; slot < m_num_slots; slot++)
+    {
+      memcpy(new_data_ptr + slot * slot_size, m_ring_data_ptr + slot * m_slot_size, m_slot_size);
+    }
+
+    new_buffer->references = 1;
+    m_field_header_ptr->buffer = new_buffer;
+    m_generation_ptr->store(generation, boost::memory_order_release); //before any tag we write into the new generation
+    lock.unlock();
+
+    SlotBuffer* old_buffer = m_slot_buffer_ptr;
+    m_slot_buffer_ptr = new_buffer;
+    m_ring_data_ptr = new_data_ptr;
+    m_slot_size = slot_size;
+    releaseSlotBuffer(old_buffer);
+    m_read_buffer.resize(m_slot_size);
+    prefault();
+    return true;
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::hasData()
+  {
+    PRINT_TRACE_ENTER
+    bool has_data = m_buffer_sequence_id_ptr->load(boost::memory_order_acquire) != 0;
+    m_already_read_valid = has_data;
+    PRINT_TRACE_EXIT
+    return has_data;
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::hasNewData()
+  {
+    return checkConnection() && m_last_read_buffer_sequence_id != m_buffer_sequence_id_ptr->load(boost::memory_order_seq_cst);
+  }
+
+  //bell is the index of a WaitSet's bell in the interface's Doorbell, bit the one the set gave us in its ready mask
+  template<typename T>
+  void SharedMemoryTransport<T>::watch(uint32_t bell, uint32_t bit)
+  {
+    if(m_watch != 0)
+    {
+      return;
+    }
+    m_watch = ((uint64_t) (bell + 1) << 32) | (bit % 64);
+    if(m_connected) //otherwise connect takes care of it
+    {
+      claimWatchEntry();
+    }
+  }
+
+  //Takes a free entry in the field's watches. Entries whose bell was let go of, or whose WaitSet's process is gone, are
+  //free too. A full table isn't fatal, the WaitSet still looks at us whenever it has waited a while without a ring.
+  template<typename T>
+  void SharedMemoryTransport<T>::claimWatchEntry()
+  {
+    SMAtomicUInt64* table = m_field_header_ptr->watches;
+    if(m_watch_entry_ptr >= table && m_watch_entry_ptr < table + SM_MAX_WATCHES) //reconnecting to the same field
+    {
+      return;
+    }
+    m_watch_entry_ptr = NULL;
+    for(unsigned int i = 0; i < SM_MAX_WATCHES; i++)
+    {
+      uint64_t watch = table[i].load(boost::memory_order_relaxed);
+      if(watch != 0)
+      {
+        uint32_t pid = m_doorbell_ptr->bells[(watch >> 32) - 1].pid.load(boost::memory_order_relaxed);
+        if(pid != 0 && processAlive(pid))
+        {
+          continue;
+        }
+      }
+      if(table[i].compare_exchange_strong(watch, m_watch, boost::memory_order_seq_cst))
+      {
+        if(watch == 0) //a stale entry was counted already
+        {
+          m_watcher_count_ptr->fetch_add(1, boost::memory_order_seq_cst);
+        }
+        m_watch_entry_ptr = &table[i];
+        return;
+      }
+    }
+    ROS_ID_WARN_STREAM("The watch table of field " << m_field_name << " is full (" << SM_MAX_WATCHES << " WaitSet members), its WaitSet will be slow to notice its messages!");
+  }
+
+  template<typename T>
+  void SharedMemoryTransport<T>::releaseWatchEntry()
+  {
+    uint64_t watch = m_watch;
+    if(m_watch_entry_ptr->compare_exchange_strong(watch, 0, boost::memory_order_relaxed)) //unless someone took it over
+    {
+      m_watcher_count_ptr->fetch_sub(1, boost::memory_order_relaxed);
+    }
+    m_watch_entry_ptr = NULL;
+  }
+
+  //Marks the watching members ready and rings their bells. Same protocol as a single field's wait, one level up: the
+  //bit is set and the bell rung before we check for sleepers, and a WaitSet counts itself in before it looks at its
+  //ready mask, so it either sees the bit or gets woken. See WaitSet::spinOnce
+  template<typename T>
+  void SharedMemoryTransport<T>::ringWatchers(FieldHeader* header)
+  {
+    for(unsigned int i = 0; i < SM_MAX_WATCHES; i++)
+    {
+      uint64_t watch = header->watches[i].load(boost::memory_order_relaxed);
+      if(watch == 0)
+      {
+        continue;
+      }
+      WaitSetBell& bell = m_doorbell_ptr->bells[(watch >> 32) - 1];
+      bell.ready.fetch_or(1ULL << (watch & 63), boost::memory_order_seq_cst);
+      bell.rings.fetch_add(1, boost::memory_order_seq_cst);
+      boost::atomic_thread_fence(boost::memory_order_seq_cst); //orders the ring before the check
+      if(bell.waiters.load(boost::memory_order_relaxed) != 0)
+      {
+        futexWakeAll(&bell.rings);
+      }
+    }
+  }
+
+  template<typename T>
+  Doorbell* SharedMemoryTransport<T>::getDoorbell()
+  {
+    return m_doorbell_ptr;
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::awaitNewDataPolled(T& data, double timeout)
+  {
+    return awaitNewData(data, timeout, WaitStrategy(WaitStrategy::BUSY_SPIN));
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::awaitNewData(T& data, double timeout)
+  {
+    return awaitNewData(data, timeout, WaitStrategy(WaitStrategy::BLOCK));
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::awaitNewData(T& data, double timeout, const WaitStrategy& strategy, bool latest_only)
+  {
+    PRINT_TRACE_ENTER
+    TEST_CONNECTED
+    if(stoppedWaiting() || !checkConnection())
+    {
+      PRINT_TRACE_EXIT
+      return false;
+    }
+
+    if(timeout == 0)
+    {
+      PRINT_TRACE_EXIT
+      return getData(data);
+    }
+
+    uint64_t deadline_ns = (timeout > 0)? monotonicNanoseconds() + (uint64_t) (timeout * 1e6) : 0;
+    if(m_last_read_buffer_sequence_id == m_buffer_sequence_id_ptr->load(boost::memory_order_acquire) && !waitForNewData(strategy, deadline_ns))
+    {
+      CATCH_SHUTDOWN_SIGNAL
+      if(deadline_ns != 0)
+      {
+        ROS_ID_DEBUG_THROTTLED_STREAM("Timed out while waiting for new data in field " << m_field_name << " with timeout " << timeout << "!");
+      }
+      PRINT_TRACE_EXIT
+      return false;
+    }
+
+    if(strategy.mode == WaitStrategy::ADAPTIVE)
+    {
+      uint64_t now = monotonicNanoseconds();
+      if(m_last_arrival_ns != 0)
+      {
+        uint64_t interarrival_ns = now - m_last_arrival_ns;
+        m_interarrival_ewma_ns = (m_interarrival_ewma_ns == 0)? interarrival_ns : (7 * m_interarrival_ewma_ns + interarrival_ns) / 8;
+      }
+      m_last_arrival_ns = now;
+    }
+
+    PRINT_TRACE_EXIT
+    return latest_only? getData(data) : getNextData(data);
+  }
+
+  //Wakes whoever sleeps on the field's sequence word, so our own waiter notices the flag right away. The others go back
+  //to sleep. One that was about to sleep when we woke everyone sees the flag on its next wakeup instead
+  template<typename T>
+  void SharedMemoryTransport<T>::stopWaiting()
+  {
+    m_stop_waiting.store(true, boost::memory_order_seq_cst);
+    if(initialized() && m_connected)
+    {
+      futexWakeAll(m_buffer_sequence_id_ptr);
+    }
+  }
+
+  template<typename T>
+  bool SharedMemoryTransport<T>::stoppedWaiting()
+  {
+    return m_stop_waiting.load(boost::memory_order_relaxed);
+  }
+
+  //returns true once the sequence has moved past our cursor, false on timeout or shutdown
+  template<typename T>
+  bool SharedMemoryTransport<T>::waitForNewData(const WaitStrategy& strategy, uint64_t deadline_ns)
+  {
+    switch(strategy.mode)
+    {
+      case WaitStrategy::BUSY_SPIN:
+        return spinForNewData(~0ULL, deadline_ns, false, false);
+      case WaitStrategy::SPIN_PAUSE:
+        return spinForNewData(~0ULL, deadline_ns, true, false);
+      case WaitStrategy::SPIN_YIELD_BLOCK:
+        return spinForNewData(strategy.spin_iterations, deadline_ns, true, false) || spinForNewData(strategy.yield_iterations, deadline_ns, false, true) || blockForNewData(deadline_ns);
+      case WaitStrategy::ADAPTIVE:
+      {
+        if(m_interarrival_ewma_ns == 0 || m_interarrival_ewma_ns > 100 * strategy.max_spin_ns) //no history yet, or too slow for spinning to matter
+        {
+          return blockForNewData(deadline_ns);
+        }
+        uint64_t now = monotonicNanoseconds();
+        uint64_t expected_ns = m_last_arrival_ns + m_interarrival_ewma_ns;
+        uint64_t spin_start_ns = (expected_ns > strategy.max_spin_ns / 2)? expected_ns - strategy.max_spin_ns / 2 : 0;
+        if(spin_start_ns > now) //sleep through the quiet part of the period. A publish still wakes us early
+        {
+          uint64_t sleep_until_ns = (deadline_ns != 0)? std::min(spin_start_ns, deadline_ns) : spin_start_ns;
+          if(blockForNewData(sleep_until_ns))
+          {
+            return true;
+          }
+          now = monotonicNanoseconds();
+        }
+        uint64_t spin_until_ns = now + strategy.max_spin_ns;
+        if(deadline_ns != 0)
+        {
+          spin_until_ns = std::min(spin_until_ns, deadline_ns);
+        }
+        return spinForNewData(~0ULL, spin_until_ns, true, false) || blockForNewData(deadline_ns); //late or skipped message
+      }
+      case WaitStrategy::BLOCK:
+      default:
+        return blockForNewData(deadline_ns);
+    }
+  }
+
+  //until_ns of 0 means no time limit. Shutdown and the clock are only checked every so often to keep the loop tight
+  template<typename T>
+  bool SharedMemoryTransport<T>::spinForNewData(uint64_t iterations, uint64_t until_ns, bool pause, bool yield)
+  {
+    for(uint64_t i = 0; i < iterations; i++)
+    {
+      if(m_last_read_buffer_sequence_id != m_buffer_sequence_id_ptr->load(boost::memory_order_acquire))
+      {
+        return true;
+      }
+      if(yield)
+      {
+        sched_yield();
+      }
+      else if(pause)
+      {
+        cpuRelax();
+      }
+      if(yield || (i & 255) == 255)
+      {
+        if(!initialized() || !ros::ok() || stoppedWaiting() || m_field_header_ptr->retired.load(boost::memory_order_relaxed) != 0 || (until_ns != 0 && monotonicNanoseconds() >= until_ns))
+        {
+          return false;
+        }
+      }
+    }
+    return false;
+  }
+
+  //until_ns of 0 means no time limit
+  template<typename T>
+  bool SharedMemoryTransport<T>::blockForNewData(uint64_t until_ns)
+  {
+    //Register as a waiter before the last look at the sequence. The writer publishes the sequence before it checks the
+    //waiter count (with a full fence in between), so either it sees us and wakes us, or we see its sequence here. The
+    //kernel re-checks the word when we go to sleep, so a publish in between just makes the wait return immediately.
+    m_waiter_count_ptr->fetch_add(1, boost::memory_order_seq_cst);
+    bool got_data = false;
+    uint32_t buffer_sequence_id;
+    while(ros::ok() && initialized() && !stoppedWaiting() && m_field_header_ptr->retired.load(boost::memory_order_relaxed) == 0)
+    {
+      buffer_sequence_id = m_buffer_sequence_id_ptr->load(boost::memory_order_seq_cst);
+      if(buffer_sequence_id != m_last_read_buffer_sequence_id)
+      {
+        got_data = true;
+        break;
+      }
+
+      uint64_t wait_ns = 100000000; //wake up now and then so a destroyed interface or ros shutdown doesn't strand us
+      if(until_ns != 0)
+      {
+        uint64_t now = monotonicNanoseconds();
+        if(now >= until_ns)
+        {
+          break;
+        }
+        wait_ns = std::min(wait_ns, until_ns - now);
+      }
+      if(m_reader_entry_ptr != NULL) //still alive, just nothing to read
+      {
+        m_reader_entry_ptr->heartbeat_ns.store(coarseMonotonicNanoseconds(), boost::memory_order_relaxed);
+      }
+      struct timespec wait_time;
+      wait_time.tv_sec = 0;
+      wait_time.tv_nsec = wait_ns;
+      futexWait(m_buffer_sequence_id_ptr, buffer_sequence_id, &wait_time);
+    }
+    m_waiter_count_ptr->fetch_sub(1, boost::memory_order_relaxed);
+    return got_data;
+  }
+
+  template<typename T>
+  uint32_t SharedMemoryTransport<T>::getLastReadSequence()
+  {
+    return m_last_read_buffer_sequence_id;
+  }
+
+  //counts the messages we overran or, reading the latest, passed over. Reading in order, the ones our process'
+  //publishers delivered to us directly don't count
+  template<typename T>
+  uint32_t SharedMemoryTransport<T>::getLastReadSkipped()
+  {
+    return m_last_read_skipped;
+  }
+
+  template<typename T>
+  uint64_t SharedMemoryTransport<T>::getLastReadPublishTime()
+  {
+    return m_read_publish_ns;
+  }
+
+  template<typename T>
+  void SharedMemoryTransport<T>::recordLatency(uint64_t latency_ns)
+  {
+    if(m_connected && initialized())
+    {
+      m_field_header_ptr->latency->record(latency_ns);
+    }
+  }
+
+  template<typename T>
+  LatencyStats SharedMemoryTransport<T>::getLatencyStats()
+  {
+    if(!m_connected || !initialized())
+    {
+      return LatencyStats();
+    }
+    return m_field_header_ptr->latency->stats();
+  }
+
+  template<typename T>
+  void SharedMemoryTransport<T>::resetLatencyStats()
+  {
+    if(m_connected && initialized())
+    {
+      m_field_header_ptr->latency->reset();
+    }
+  }
+
+  template<typename T>
+  std::string SharedMemoryTransport<T>::getFieldName()
+  {
+    return m_field_name;
+  }
+
+  template<typename T>
+  std::string SharedMemoryTransport<T>::getMD5Sum()
+  {
+    return (initialized() && m_connected)? m_field_header_ptr->md5sum : "";
+  }
+
+  template<typename T>
+  std::string SharedMemoryTransport<T>::getDataType()
+  {
+    return (initialized() && m_connected)? m_field_header_ptr->datatype : "";
   }
 }
 #endif //SHARED_MEMORY_TRANSPORT_IMPL_HPP
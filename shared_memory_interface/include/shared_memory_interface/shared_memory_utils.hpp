@@ -40,12 +40,25 @@
 #include <ros/package.h>
 
 #include <vector>
+#include <set>
+#include <fstream>
+#include <cstring>
 #include <stdio.h>
 #include <algorithm>
 #include <stdlib.h>
+#include <math.h>
 
 #include <unistd.h>
 #include <pwd.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/statvfs.h>
+#include <linux/futex.h>
 
 #include <boost/interprocess/shared_memory_object.hpp>
 #include <boost/interprocess/mapped_region.hpp>
@@ -60,7 +73,9 @@
 #include <boost/thread/thread_time.hpp>
 
 #include <boost/interprocess/sync/interprocess_mutex.hpp>
-#include <boost/interprocess/sync/interprocess_condition.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/static_assert.hpp>
 
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
@@ -90,11 +105,249 @@ namespace shared_memory_interface
 
 #define TEST_INITIALIZED if(!m_initialized) {ROS_ID_ERROR_STREAM("Tried to call " <<__func__ << " on an uninitialized shared memory transport!"); return false;}
 #define TEST_CONNECTED if(!m_connected) {ROS_ID_ERROR_STREAM("Tried to call " <<__func__ << " on an unconnected shared memory transport!"); return false;}
-#define CATCH_SHUTDOWN_SIGNAL if(!m_initialized) {ROS_ID_DEBUG_STREAM("Caught shutdown signal in function " <<__func__ << "!"); return false;}
+#define CATCH_SHUTDOWN_SIGNAL if(!initialized()) {ROS_ID_DEBUG_STREAM("Caught shutdown signal in function " <<__func__ << "!"); return false;}
 
   typedef boost::interprocess::allocator<char, boost::interprocess::managed_shared_memory::segment_manager> SMCharAllocator;
   typedef boost::interprocess::basic_string<char, std::char_traits<char>, SMCharAllocator> SMString;
 
+  //atomics that live in shared memory must never fall back to boost's process-local lock pool
+  typedef boost::atomic<uint32_t> SMAtomicUInt32;
+  BOOST_STATIC_ASSERT(BOOST_ATOMIC_INT32_LOCK_FREE == 2);
+  BOOST_STATIC_ASSERT(sizeof(SMAtomicUInt32) == sizeof(uint32_t)); //the kernel sees the futex word directly
+  typedef boost::atomic<uint64_t> SMAtomicUInt64;
+  BOOST_STATIC_ASSERT(BOOST_ATOMIC_INT64_LOCK_FREE == 2);
+
+  //Sleeps until word is woken or no longer holds expected. Returns false on timeout, true otherwise (including spurious
+  //wakeups and signals, so callers must re-check their predicate). The futex is shared, not private, since the word lives
+  //in shared memory and the waker is usually another process.
+  inline bool futexWait(SMAtomicUInt32* word, uint32_t expected, const struct timespec* timeout)
+  {
+    if(syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, timeout, NULL, 0) == 0)
+    {
+      return true;
+    }
+    return errno != ETIMEDOUT;
+  }
+
+  inline void futexWakeAll(SMAtomicUInt32* word)
+  {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+  }
+
+#define SM_CACHE_LINE_SIZE 64
+#define SM_MAX_WAIT_SETS 64 //WaitSets that can sleep on one interface at a time, see Doorbell
+
+  //A WaitSet's own futex. Writers to a field the set watches mark the member in ready before they bump rings, so the set
+  //only looks at the members that were written to, and traffic on fields nobody in the set watches never wakes it.
+  struct WaitSetBell
+  {
+    WaitSetBell() :
+        ready(0), pid(0), rings(0), waiters(0)
+    {
+    }
+
+    SMAtomicUInt64 ready; //bit i % 64 is set when member i of the set may have news
+    SMAtomicUInt32 pid; //of the set's process, 0 if the bell is free
+    SMAtomicUInt32 rings;
+    SMAtomicUInt32 waiters;
+    char padding[SM_CACHE_LINE_SIZE - sizeof(SMAtomicUInt64) - 3 * sizeof(SMAtomicUInt32)];
+  };
+
+  //One per interface, holding the bells of the WaitSets that wait on its fields, so writers in any process can ring
+  //them. Fields list the bells that watch them, see FieldHeader::watches.
+  struct Doorbell
+  {
+    WaitSetBell bells[SM_MAX_WAIT_SETS];
+  };
+
+#define SM_MAX_FIELDS 512
+#define SM_MAX_NAME_LENGTH 128
+
+  struct FieldDirectoryEntry
+  {
+    char field_name[SM_MAX_NAME_LENGTH]; //empty if the entry is free
+    char group[SM_MAX_NAME_LENGTH]; //empty if the field lives in the interface's own segment
+    boost::interprocess::managed_shared_memory::handle_t header; //where the field's FieldHeader is in its segment, 0 until it's created
+  };
+
+  //One per interface, in the interface's own segment. Lists every field along with the group segment it lives in, so
+  //fields can be moved out into segments of their own (see SharedMemoryTransport::setSegmentGroup) and still be found
+  //by name. Everything in here is guarded by mutex.
+  struct FieldDirectory
+  {
+    FieldDirectory()
+    {
+      memset(entries, 0, sizeof(entries));
+    }
+
+    FieldDirectoryEntry* find(const std::string& field_name)
+    {
+      for(unsigned int i = 0; i < SM_MAX_FIELDS; i++)
+      {
+        if(field_name == entries[i].field_name)
+        {
+          return &entries[i];
+        }
+      }
+      return NULL;
+    }
+
+    //returns NULL if the directory is full or a name doesn't fit
+    FieldDirectoryEntry* add(const std::string& field_name, const std::string& group)
+    {
+      if(field_name.empty() || field_name.size() >= SM_MAX_NAME_LENGTH || group.size() >= SM_MAX_NAME_LENGTH)
+      {
+        return NULL;
+      }
+      FieldDirectoryEntry* entry = find("");
+      if(entry != NULL)
+      {
+        strcpy(entry->field_name, field_name.c_str());
+        strcpy(entry->group, group.c_str());
+        entry->header = 0;
+      }
+      return entry;
+    }
+
+    void remove(FieldDirectoryEntry* entry)
+    {
+      memset(entry, 0, sizeof(FieldDirectoryEntry));
+    }
+
+    bool groupInUse(const std::string& group)
+    {
+      for(unsigned int i = 0; i < SM_MAX_FIELDS; i++)
+      {
+        if(entries[i].field_name[0] != '\0' && group == entries[i].group)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    boost::interprocess::interprocess_mutex mutex;
+    FieldDirectoryEntry entries[SM_MAX_FIELDS];
+  };
+
+  //the name of the segment that holds the fields of group. Shared memory names can't contain slashes
+  inline std::string groupSegmentName(std::string interface_name, std::string group)
+  {
+    std::replace(group.begin(), group.end(), '/', '_');
+    return interface_name + "." + group;
+  }
+
+  //tells the core we're in a spin loop, so it can save power and give the other hyperthread a go
+  inline void cpuRelax()
+  {
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+  }
+
+  //false only if pid definitely doesn't exist. Processes in another pid namespace look dead too, so don't go on this alone
+  inline bool processAlive(uint32_t pid)
+  {
+    return kill(pid, 0) == 0 || errno != ESRCH;
+  }
+
+  inline uint64_t monotonicNanoseconds()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+  }
+
+  //same clock as monotonicNanoseconds, but only as fine as the scheduler tick, which makes it several times cheaper
+  inline uint64_t coarseMonotonicNanoseconds()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+  }
+
+  //How a subscriber waits for the next message.
+  //  BLOCK:            sleep on the field's futex. Cheapest, but pays the kernel wakeup latency.
+  //  BUSY_SPIN:        spin on the sequence word without pausing. Lowest latency, burns a whole core.
+  //  SPIN_PAUSE:       like BUSY_SPIN, but with a pause in the loop. Nearly as fast and kinder to the hyperthread.
+  //  SPIN_YIELD_BLOCK: spin spin_iterations times, then sched_yield yield_iterations times, then block.
+  //  ADAPTIVE:         tracks the topic's inter-arrival time, sleeps until shortly before the next message is due and
+  //                    spins through the rest (at most max_spin_ns). Falls back to blocking for slow or irregular topics.
+  struct WaitStrategy
+  {
+    enum Mode
+    {
+      BLOCK, BUSY_SPIN, SPIN_PAUSE, SPIN_YIELD_BLOCK, ADAPTIVE
+    };
+
+    WaitStrategy(Mode mode = BLOCK) :
+        mode(mode), spin_iterations(2000), yield_iterations(10), max_spin_ns(200000)
+    {
+    }
+
+    Mode mode;
+    unsigned int spin_iterations;
+    unsigned int yield_iterations;
+    uint64_t max_spin_ns;
+  };
+
+  //What a transport does to its memory when it connects, so the first messages don't take page faults. FIELD covers
+  //the field's header and slots (and follows them when they grow), SEGMENT the whole interface. With lock set the pages
+  //are also mlocked, which needs CAP_IPC_LOCK or a big enough RLIMIT_MEMLOCK (ulimit -l). Locks last until the segment
+  //is unmapped.
+  struct PrefaultPolicy
+  {
+    enum Scope
+    {
+      NONE, FIELD, SEGMENT
+    };
+
+    PrefaultPolicy(Scope scope = NONE, bool lock = false) :
+        scope(scope), lock(lock)
+    {
+    }
+
+    Scope scope;
+    bool lock;
+  };
+
+  //Which messages a subscriber's callback gets.
+  //  QUEUED:      every message, oldest first. A subscriber that falls more than the topic's queue_size behind loses the
+  //               oldest ones.
+  //  LATEST_ONLY: only the newest message whenever the callback is ready for another, for state topics where an older
+  //               value is of no use once a newer one is out.
+  //Either way MessageInfo::skipped tells the callback how many messages it never got.
+  struct DeliveryPolicy
+  {
+    enum Mode
+    {
+      QUEUED, LATEST_ONLY
+    };
+
+    DeliveryPolicy(Mode mode = QUEUED) :
+        mode(mode)
+    {
+    }
+
+    Mode mode;
+  };
+
+  //Describes the message a subscriber delivered last, see Subscriber::getMessageInfo
+  struct MessageInfo
+  {
+    MessageInfo() :
+        sequence(0), skipped(0), total_skipped(0), intra_process(false)
+    {
+    }
+
+    uint32_t sequence; //number of messages published to the field up to and including this one, 0 if it never went through shared memory
+    uint32_t skipped; //messages published since the previous one we delivered that we'll never get, because we fell behind or by policy
+    uint64_t total_skipped; //since subscribing
+    bool intra_process; //handed over by a publisher in our own process
+  };
+
   inline boost::interprocess::permissions unrestricted()
   {
     boost::interprocess::permissions perm;
@@ -102,56 +355,221 @@ namespace shared_memory_interface
     return perm;
   }
 
-  inline bool createMemory(std::string interface_name, unsigned int size)
+#define SM_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+  //returns the selected transparent huge page mode for shmem (always, within_size, advise, never, deny, force), or an
+  //empty string if the kernel doesn't support THP for shmem at all. Only force and deny affect tmpfs mounts like
+  ///dev/shm, the other modes are for the kernel's internal mount (SysV shm, memfd).
+  inline std::string transparentHugePageShmemMode()
   {
-    PRINT_TRACE_ENTER
-    //make sure the system will let us create a memory space of the desired size
-    std::ifstream shmmax_file_read;
-    shmmax_file_read.open("/proc/sys/kernel/shmmax");
-    if(!shmmax_file_read.is_open())
+    std::ifstream mode_file("/sys/kernel/mm/transparent_hugepage/shmem_enabled");
+    std::string modes;
+    std::getline(mode_file, modes);
+    size_t begin = modes.find('[');
+    size_t end = modes.find(']');
+    if(begin == std::string::npos || end == std::string::npos || end < begin)
     {
-      ROS_ID_ERROR_STREAM("System shared memory maximum file not found at /proc/sys/kernel/shmmax. System may or may not have sufficient shared memory available. Are you using Ubuntu 12.04?");
+      return "";
     }
-    else
+    return modes.substr(begin + 1, end - begin - 1);
+  }
+
+  //returns the huge= option of the tmpfs that holds boost's shared memory objects (/dev/shm), "never" if it isn't set
+  inline std::string sharedMemoryMountHugeOption()
+  {
+    std::ifstream mounts("/proc/mounts");
+    std::string device, mount_point, type, options, huge = "never";
+    while(mounts >> device >> mount_point >> type >> options)
     {
-      std::string shmmax_string;
-      std::getline(shmmax_file_read, shmmax_string);
-      unsigned int shmmax = atof(shmmax_string.c_str());
-      shmmax_file_read.close();
-      if(shmmax < size)
+      mounts.ignore(1024, '\n');
+      if(mount_point != "/dev/shm")
       {
-        ROS_ID_WARN_STREAM("Available system shared memory (" << shmmax << ") was smaller than the requested size (" << size << ")! Attempting to increase it (may need sudo). To make the change persist across reboots: `rosrun shared_memory_interface set_shared_memory_size_persistent " << size << "`");
+        continue;
+      }
+      huge = "never"; //the last mount on /dev/shm is the one that counts
+      size_t option = options.find("huge=");
+      if(option != std::string::npos)
+      {
+        huge = options.substr(option + 5, options.find(',', option) - option - 5);
+      }
+    }
+    return huge;
+  }
 
-        std::stringstream ss;
-        ss << ros::package::getPath("shared_memory_interface") << "/scripts/set_shared_memory_size " << size;
-        int unused = system(ss.str().c_str());
-        unused = unused; //silly warnings are silly
+  //checks whether huge pages can back a shared memory segment, and says why not if they can't
+  inline bool hugePagesAvailable()
+  {
+    std::string mode = transparentHugePageShmemMode();
+    if(mode.empty())
+    {
+      ROS_ID_WARN_STREAM("This kernel doesn't support transparent huge pages for shared memory (no /sys/kernel/mm/transparent_hugepage/shmem_enabled)! Falling back to regular pages.");
+      return false;
+    }
+    if(mode == "force")
+    {
+      return true;
+    }
+    if(mode == "deny")
+    {
+      ROS_ID_WARN_STREAM("Transparent huge pages for shared memory are denied system wide (/sys/kernel/mm/transparent_hugepage/shmem_enabled)! Falling back to regular pages.");
+      return false;
+    }
+    std::string huge = sharedMemoryMountHugeOption();
+    if(huge == "never")
+    {
+      ROS_ID_WARN_STREAM("/dev/shm isn't mounted with huge pages enabled! Falling back to regular pages. To enable them: `sudo mount -o remount,huge=advise /dev/shm`");
+      return false;
+    }
+    ROS_ID_INFO_STREAM("Huge pages are available for shared memory (/dev/shm mounted with huge=" << huge << ").");
+    return true;
+  }
 
-        //check to see if we actually changed it
-        shmmax_file_read.open("/proc/sys/kernel/shmmax");
-        std::getline(shmmax_file_read, shmmax_string);
-        shmmax = atof(shmmax_string.c_str());
-        shmmax_file_read.close();
+  //Huge page advice applies to a mapping, not to the memory behind it, so every process has to give it for its own
+  //mapping of the segment. Pages that were already faulted in only get collapsed later by khugepaged.
+  inline void adviseHugePages(void* address, size_t size)
+  {
+    if(madvise(address, size, MADV_HUGEPAGE) != 0)
+    {
+      ROS_ID_WARN_STREAM("madvise(MADV_HUGEPAGE) failed with error " << errno << " (" << strerror(errno) << "). Using regular pages.");
+    }
+  }
 
-        if(shmmax == size)
-        {
-          ROS_ID_INFO_STREAM("Successfully increased system shared memory!");
-        }
-        else
+  //how much of the mapping that contains address is currently backed by huge pages, according to /proc/self/smaps
+  inline unsigned long hugePageBytesMapped(void* address)
+  {
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool in_mapping = false;
+    while(std::getline(smaps, line))
+    {
+      unsigned long begin, end;
+      if(sscanf(line.c_str(), "%lx-%lx ", &begin, &end) == 2 && line.find(':') > line.find(' ')) //a mapping's header line
+      {
+        in_mapping = ((unsigned long) address >= begin && (unsigned long) address < end);
+      }
+      else if(in_mapping && (line.compare(0, 15, "ShmemPmdMapped:") == 0 || line.compare(0, 14, "FilePmdMapped:") == 0))
+      {
+        unsigned long kb = 0;
+        sscanf(line.c_str() + line.find(':') + 1, "%lu", &kb);
+        if(kb != 0)
         {
-          ROS_ID_WARN_STREAM("Failed to increase system shared memory, and will continue using the current maximum " << shmmax << "! If you really need more space, you may need to increase it manually (`rosrun shared_memory_interface set_shared_memory_size_persistent " << size << "` or `rosrun shared_memory_interface set_shared_memory_size " << size << ").");
-          size = shmmax;
+          return kb * 1024;
         }
       }
     }
+    return 0;
+  }
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23 //Linux 5.14, older headers don't know it
+#endif
+
+  //faults in every page of [address, address + size) for writing, and mlocks them if lock is set. The contents are
+  //left alone, so this is safe on memory other processes are using. Returns false if the pages couldn't be locked.
+  inline bool prefaultMemory(void* address, size_t size, bool lock)
+  {
+    if(size == 0)
+    {
+      return true;
+    }
+    unsigned long page_size = sysconf(_SC_PAGESIZE);
+    unsigned long begin = (unsigned long) address / page_size * page_size;
+    unsigned long end = ((unsigned long) address + size + page_size - 1) / page_size * page_size;
+    if(madvise((void*) begin, end - begin, MADV_POPULATE_WRITE) != 0) //older kernel, touch the pages ourselves
+    {
+      for(unsigned long page = begin; page < end; page += page_size)
+      {
+        __sync_fetch_and_add((volatile unsigned char*) page, 0); //a write fault that can't clobber a concurrent write
+      }
+    }
+
+    if(lock && mlock((void*) begin, end - begin) != 0)
+    {
+      ROS_ID_WARN_STREAM("Couldn't lock " << (end - begin) << " bytes of shared memory: " << strerror(errno) << ". Raise the memlock limit (ulimit -l) or grant CAP_IPC_LOCK.");
+      return false;
+    }
+    return true;
+  }
+
+  //reads the number in a /proc/sys file, 0 if there isn't one
+  inline uint64_t readSysctl(std::string path)
+  {
+    std::ifstream file(path.c_str());
+    std::string value;
+    std::getline(file, value);
+    return strtoull(value.c_str(), NULL, 10);
+  }
+
+  //free space in the tmpfs that holds boost's shared memory objects. Segments are sparse, so a segment bigger than this
+  //is created just fine and the process touching the missing pages gets a SIGBUS later on
+  inline uint64_t sharedMemoryMountAvailable()
+  {
+    struct statvfs stats;
+    if(statvfs("/dev/shm", &stats) != 0)
+    {
+      return 0;
+    }
+    return (uint64_t) stats.f_bavail * stats.f_frsize;
+  }
+
+  inline bool createMemory(std::string interface_name, uint64_t size, bool use_huge_pages = false)
+  {
+    PRINT_TRACE_ENTER
+    //make sure the system will let us create a memory space of the desired size
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t shmmax = readSysctl("/proc/sys/kernel/shmmax");
+    uint64_t shmall = readSysctl("/proc/sys/kernel/shmall"); //in pages
+    if(shmmax == 0)
+    {
+      ROS_ID_ERROR_STREAM("System shared memory maximum file not found at /proc/sys/kernel/shmmax. System may or may not have sufficient shared memory available. Are you using Ubuntu 12.04?");
+    }
+    else if(shmmax < size || shmall < (size + page_size - 1) / page_size)
+    {
+      ROS_ID_WARN_STREAM("Available system shared memory (shmmax " << shmmax << ", shmall " << shmall << " pages) was smaller than the requested size (" << size << ")! Attempting to increase it (may need sudo). To make the change persist across reboots: `rosrun shared_memory_interface set_shared_memory_size_persistent " << size << "`");
+
+      std::stringstream ss;
+      ss << ros::package::getPath("shared_memory_interface") << "/scripts/set_shared_memory_size " << size;
+      int unused = system(ss.str().c_str());
+      unused = unused; //silly warnings are silly
+
+      //check to see if we actually changed it
+      shmmax = readSysctl("/proc/sys/kernel/shmmax");
+      shmall = readSysctl("/proc/sys/kernel/shmall");
+
+      if(shmmax >= size && shmall >= (size + page_size - 1) / page_size)
+      {
+        ROS_ID_INFO_STREAM("Successfully increased system shared memory!");
+      }
+      else
+      {
+        ROS_ID_WARN_STREAM("Failed to increase system shared memory, and will continue using the current maximum " << shmmax << "! If you really need more space, you may need to increase it manually (`rosrun shared_memory_interface set_shared_memory_size_persistent " << size << "` or `rosrun shared_memory_interface set_shared_memory_size " << size << ").");
+        size = std::min(size, shmmax);
+      }
+    }
+
+    uint64_t available = sharedMemoryMountAvailable();
+    if(available < size)
+    {
+      ROS_ID_ERROR_STREAM("/dev/shm only has " << available << " bytes free, but " << interface_name << " needs " << size << "! Publishers will crash with SIGBUS once the segment fills up. Make room with `sudo mount -o remount,size=" << (size + (1ull << 30) - 1) / (1ull << 30) << "G /dev/shm`.");
+    }
+
+    if(use_huge_pages && hugePagesAvailable())
+    {
+      size = (size + SM_HUGE_PAGE_SIZE - 1) / SM_HUGE_PAGE_SIZE * SM_HUGE_PAGE_SIZE; //a partial huge page at the end would be wasted
+    }
+    else
+    {
+      use_huge_pages = false;
+    }
 
     //try to create the memory space
     try
     {
-      ROS_ID_INFO_STREAM("Creating shared memory space " << interface_name << "..");
+      ROS_ID_INFO_STREAM("Creating shared memory space " << interface_name << (use_huge_pages? " backed by huge pages" : "") << "..");
       boost::interprocess::managed_shared_memory segment = boost::interprocess::managed_shared_memory(boost::interprocess::create_only, interface_name.c_str(), size, NULL, unrestricted());
       ROS_ID_INFO_STREAM("Created " << interface_name << " space!");
 
+      segment.construct<bool>("huge_pages")(use_huge_pages); //tells everyone who maps the segment to ask for huge pages too
       segment.construct<bool>("shutdown_required")(false);
     }
     catch(boost::interprocess::interprocess_exception &ex) //shared memory hasn't been created yet, so we'll make it
@@ -163,6 +581,20 @@ namespace shared_memory_interface
     return true;
   }
 
+  //unlinks a group segment and tells everyone who has it mapped to let go of it, which returns its memory to the OS
+  inline void destroyGroupSegment(std::string segment_name)
+  {
+    try
+    {
+      boost::interprocess::managed_shared_memory segment = boost::interprocess::managed_shared_memory(boost::interprocess::open_only, segment_name.c_str());
+      *segment.find<bool>("shutdown_required").first = true; //first, so whoever opens it before the unlink knows it is dying
+      boost::interprocess::shared_memory_object::remove(segment_name.c_str());
+    }
+    catch(boost::interprocess::interprocess_exception &ex) //already gone
+    {
+    }
+  }
+
   //cerr used below because ROS doesn't work after ros::shutdown has happened.
   inline void destroyMemory(std::string interface_name)
   {
@@ -172,6 +604,22 @@ namespace shared_memory_interface
     {
       boost::interprocess::managed_shared_memory segment = boost::interprocess::managed_shared_memory(boost::interprocess::open_only, interface_name.c_str());
       boost::interprocess::shared_memory_object::remove(interface_name.c_str());
+      FieldDirectory* directory = segment.find<FieldDirectory>("field_directory").first;
+      if(directory != NULL) //group segments go down with their interface
+      {
+        std::set<std::string> groups;
+        for(unsigned int i = 0; i < SM_MAX_FIELDS; i++)
+        {
+          if(directory->entries[i].field_name[0] != '\0' && directory->entries[i].group[0] != '\0')
+          {
+            groups.insert(groupSegmentName(interface_name, directory->entries[i].group));
+          }
+        }
+        for(std::set<std::string>::iterator group = groups.begin(); group != groups.end(); group++)
+        {
+          destroyGroupSegment(*group);
+        }
+      }
       *segment.find<bool>("shutdown_required").first = true; //inform the other processes that the shared memory needs to close
     }
     catch(boost::interprocess::interprocess_exception &ex)
@@ -0,0 +1,280 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SHARED_MEMORY_WAIT_SET_HPP
+#define SHARED_MEMORY_WAIT_SET_HPP
+
+#include "shared_memory_utils.hpp"
+
+namespace shared_memory_interface
+{
+  //Services the callbacks of many subscribers from one thread, or a small pool of them, instead of a thread per
+  //subscriber. Members are added through Subscriber::subscribe(topic, callback, wait_set). All of them must live on the
+  //same interface, since the set sleeps on a bell in that interface's Doorbell. Subscribers have to outlive the set.
+  //
+  //Publishers to a member's field set the member's bit in the bell's ready mask before they ring it, so a wakeup only
+  //looks at the members that were written to, not at every member of the set.
+  //
+  //Either call spinOnce from your own loop, or start() the pool and let it run until stop() or destruction.
+  class WaitSet
+  {
+  public:
+    WaitSet(unsigned int num_threads = 1)
+    {
+      m_num_threads = std::max(num_threads, 1u);
+      m_doorbell_ptr = NULL;
+      m_bell_ptr = NULL;
+      m_bell = 0;
+      m_running = false;
+    }
+
+    ~WaitSet()
+    {
+      stop();
+      if(m_bell_ptr != NULL)
+      {
+        m_bell_ptr->pid.store(0, boost::memory_order_release);
+      }
+      for(unsigned int i = 0; i < m_entries.size(); i++)
+      {
+        delete m_entries[i];
+      }
+    }
+
+    //watch asks the member's field to ring our bell, giving it our bell's index and the member's bit. ready returns
+    //true if the member has an unread message. dispatch delivers (at most) one of them and returns true if it did,
+    //connecting first if it has to. Don't add members while the set is spinning.
+    bool add(std::string interface_name, Doorbell* doorbell, boost::function<void(uint32_t, uint32_t)> watch, boost::function<bool()> ready, boost::function<bool()> dispatch)
+    {
+      if(m_doorbell_ptr == NULL)
+      {
+        if(!claimBell(doorbell))
+        {
+          ROS_ERROR_STREAM("WaitSet: Interface " << interface_name << " already has " << SM_MAX_WAIT_SETS << " WaitSets waiting on it!");
+          return false;
+        }
+        m_interface_name = interface_name;
+      }
+      else if(interface_name != m_interface_name)
+      {
+        ROS_ERROR_STREAM("WaitSet: Can't wait on interface " << interface_name << " and " << m_interface_name << " at the same time!");
+        return false;
+      }
+
+      Entry* entry = new Entry;
+      entry->ready = ready;
+      entry->dispatch = dispatch;
+      m_entries.push_back(entry);
+      uint32_t bit = (m_entries.size() - 1) % 64;
+      watch(m_bell, bit);
+      m_bell_ptr->ready.fetch_or(1ULL << bit, boost::memory_order_relaxed); //so the first pass looks at it
+      return true;
+    }
+
+    void start()
+    {
+      if(m_running)
+      {
+        return;
+      }
+      m_running = true;
+      for(unsigned int i = 0; i < m_num_threads; i++)
+      {
+        m_threads.create_thread(boost::bind(&WaitSet::threadFunction, this));
+      }
+    }
+
+    void stop()
+    {
+      m_running = false; //the pool notices within one wait slice
+      m_threads.join_all();
+    }
+
+    //delivers every message that is ready, waiting up to timeout ms (forever if negative) for the first one. Returns
+    //false if nothing was delivered.
+    bool spinOnce(double timeout = -1)
+    {
+      uint64_t deadline_ns = (timeout >= 0)? monotonicNanoseconds() + (uint64_t) (timeout * 1e6) : 0;
+      //members that haven't connected yet, or whose field's watch table was full, can't ring, so all of them are looked
+      //at when a caller polls us or a wait slice passes without a ring
+      bool look_at_all = (timeout == 0);
+      while(ros::ok())
+      {
+        if(dispatchReady(look_at_all))
+        {
+          while(dispatchReady(false)) //drain, one message per member per pass so busy topics don't starve the rest
+          {
+          }
+          return true;
+        }
+        look_at_all = false;
+
+        uint64_t wait_ns = 100000000;
+        if(deadline_ns != 0)
+        {
+          uint64_t now = monotonicNanoseconds();
+          if(now >= deadline_ns)
+          {
+            return false;
+          }
+          wait_ns = std::min(wait_ns, deadline_ns - now);
+        }
+        struct timespec wait_time;
+        wait_time.tv_sec = 0;
+        wait_time.tv_nsec = wait_ns;
+
+        if(m_bell_ptr == NULL)
+        {
+          nanosleep(&wait_time, NULL);
+          continue;
+        }
+        //same protocol as a single field's wait: count ourselves in, take the ring count, look at the ready mask, then
+        //sleep on the ring count we saw. A writer marks its member and rings before it checks for sleepers, so we
+        //either see its bit or its ring.
+        m_bell_ptr->waiters.fetch_add(1, boost::memory_order_seq_cst);
+        uint32_t rings = m_bell_ptr->rings.load(boost::memory_order_seq_cst);
+        if(m_bell_ptr->ready.load(boost::memory_order_seq_cst) == 0)
+        {
+          look_at_all = !futexWait(&m_bell_ptr->rings, rings, &wait_time);
+        }
+        m_bell_ptr->waiters.fetch_sub(1, boost::memory_order_relaxed);
+      }
+      return false;
+    }
+
+  private:
+    struct Entry
+    {
+      Entry() :
+          busy(false), missed(false)
+      {
+      }
+
+      boost::function<bool()> ready;
+      boost::function<bool()> dispatch;
+      boost::atomic<bool> busy; //a member's transport isn't thread safe, so only one pool thread may touch it at a time
+      boost::atomic<bool> missed; //another pool thread took the member's bit while it was busy
+    };
+
+    std::vector<Entry*> m_entries;
+    std::string m_interface_name;
+    Doorbell* m_doorbell_ptr;
+    WaitSetBell* m_bell_ptr;
+    uint32_t m_bell; //m_bell_ptr's index in m_doorbell_ptr
+    unsigned int m_num_threads;
+    boost::thread_group m_threads;
+    boost::atomic<bool> m_running;
+
+    //takes a free bell, or one whose set's process is gone
+    bool claimBell(Doorbell* doorbell)
+    {
+      uint32_t own_pid = getpid();
+      for(unsigned int i = 0; i < SM_MAX_WAIT_SETS; i++)
+      {
+        uint32_t pid = doorbell->bells[i].pid.load(boost::memory_order_relaxed);
+        if((pid == 0 || !processAlive(pid)) && doorbell->bells[i].pid.compare_exchange_strong(pid, own_pid, boost::memory_order_acquire))
+        {
+          m_doorbell_ptr = doorbell;
+          m_bell_ptr = &doorbell->bells[i];
+          m_bell = i;
+          m_bell_ptr->ready.store(0, boost::memory_order_relaxed); //the last owner's members aren't ours
+          return true;
+        }
+      }
+      return false;
+    }
+
+    //dispatches one message from each member whose bit is set (or from every member), and sets the bits of those that
+    //have more again, so a pass never misses a member that a writer or another pool thread marked
+    bool dispatchReady(bool look_at_all)
+    {
+      if(m_bell_ptr == NULL)
+      {
+        return false;
+      }
+      uint64_t ready = m_bell_ptr->ready.exchange(0, boost::memory_order_seq_cst);
+      if(look_at_all)
+      {
+        ready = ~0ULL;
+      }
+      if(ready == 0)
+      {
+        return false;
+      }
+
+      bool dispatched = false;
+      for(unsigned int i = 0; i < m_entries.size(); i++)
+      {
+        uint64_t bit = 1ULL << (i % 64);
+        if((ready & bit) == 0)
+        {
+          continue;
+        }
+        Entry* entry = m_entries[i];
+        if(entry->busy.exchange(true, boost::memory_order_seq_cst))
+        {
+          //whoever has it looks at the mark after letting go. If it let go before we made it, the bit is on us
+          entry->missed.store(true, boost::memory_order_seq_cst);
+          if(!entry->busy.load(boost::memory_order_seq_cst))
+          {
+            m_bell_ptr->ready.fetch_or(bit, boost::memory_order_seq_cst);
+          }
+          continue;
+        }
+        bool more = false;
+        if(entry->dispatch())
+        {
+          dispatched = true;
+          more = entry->ready();
+        }
+        entry->busy.store(false, boost::memory_order_seq_cst);
+        if(entry->missed.exchange(false, boost::memory_order_seq_cst))
+        {
+          more = true;
+        }
+        if(more)
+        {
+          m_bell_ptr->ready.fetch_or(bit, boost::memory_order_seq_cst);
+        }
+      }
+      return dispatched;
+    }
+
+    void threadFunction()
+    {
+      while(m_running && ros::ok())
+      {
+        spinOnce(100);
+      }
+    }
+  };
+}
+#endif //SHARED_MEMORY_WAIT_SET_HPP
@@ -40,8 +40,9 @@ namespace shared_memory_interface
   {
     m_nh.param("loop_rate", m_loop_rate, 10.0);
     m_nh.param("interface_name", m_interface_name, std::string("smi"));
-    m_nh.param("memory_size", m_memory_size, 512.0 * 1024.0 * 1024.0); //param is double because ros apparently doesn't like unsigned int
-    if(!createMemory(m_interface_name, (unsigned int) m_memory_size))
+    m_nh.param("memory_size", m_memory_size, 512.0 * 1024.0 * 1024.0); //param is double because ros params can't hold 64 bit integers
+    m_nh.param("use_huge_pages", m_use_huge_pages, false); //back the segment with transparent huge pages, if the kernel allows it
+    if(!createMemory(m_interface_name, (uint64_t) m_memory_size, m_use_huge_pages))
     {
       ROS_WARN("Another shared_memory_manager appears to be running. Shutting down!");
       ros::shutdown();
@@ -0,0 +1,246 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "shared_memory_interface/shared_memory_transport.hpp"
+#include <stdio.h>
+#include <unistd.h>
+#include <map>
+
+//Shows what's going on in an interface, one line per field, like top does for processes. It maps the segments read
+//only and reads the counters the transports keep in them (see FieldHeader and ReaderEntry) without taking any locks,
+//so it can't slow anyone down or wedge the interface. Rates are over the last refresh period, latencies are since the
+//field was created.
+
+using namespace shared_memory_interface;
+
+typedef boost::interprocess::managed_shared_memory Segment;
+
+//everything we look at in a field, so two samples can be turned into rates
+struct FieldSample
+{
+  FieldSample() :
+      messages(0), bytes(0), age_ns(0), writer_waits(0), readers(0), reads(0), read_retries(0), overruns(0), num_slots(0)
+  {
+  }
+
+  std::string datatype;
+  uint32_t messages;
+  uint64_t bytes;
+  uint64_t age_ns; //since the last message was published
+  uint32_t writer_waits;
+  uint32_t readers;
+  uint64_t reads;
+  uint64_t read_retries;
+  uint64_t overruns;
+  uint32_t num_slots;
+  LatencyStats latency;
+};
+
+//names in shared memory may be changing while we read them
+std::string copyName(const char* name)
+{
+  return std::string(name, strnlen(name, SM_MAX_NAME_LENGTH));
+}
+
+//a field may be retired and freed while we look at it, leaving garbage behind, so only follow pointers that stay
+//inside the segment
+bool insideSegment(Segment& segment, const void* ptr, unsigned long size)
+{
+  const char* begin = (const char*) segment.get_address();
+  return (const char*) ptr >= begin && (const char*) ptr + size <= begin + segment.get_size();
+}
+
+bool sampleField(Segment& segment, Segment::handle_t header_handle, FieldSample& sample)
+{
+  FieldHeader* header = (FieldHeader*) segment.get_address_from_handle(header_handle);
+  if(header_handle == 0 || !insideSegment(segment, header, sizeof(FieldHeader)) || header->ready.load(boost::memory_order_acquire) == 0)
+  {
+    return false;
+  }
+  if(header->num_slots == 0 || !insideSegment(segment, header->slots.get(), header->num_slots * sizeof(SlotState)) || !insideSegment(segment, header->reader_table.get(), SM_MAX_READERS * sizeof(ReaderEntry)))
+  {
+    return false;
+  }
+
+  sample.datatype = copyName(header->datatype);
+  sample.messages = header->sequence.load(boost::memory_order_acquire);
+  sample.bytes = header->bytes_published.load(boost::memory_order_relaxed);
+  sample.writer_waits = header->writer_waits.load(boost::memory_order_relaxed);
+  sample.num_slots = header->num_slots;
+  if(sample.messages != 0)
+  {
+    uint64_t published_ns = header->slots[sample.messages % header->num_slots].publish_ns.load(boost::memory_order_relaxed);
+    uint64_t now = monotonicNanoseconds();
+    sample.age_ns = (published_ns != 0 && published_ns < now)? now - published_ns : 0;
+  }
+
+  ReaderEntry* table = header->reader_table.get();
+  for(unsigned int i = 0; i < SM_MAX_READERS; i++)
+  {
+    if(table[i].pid.load(boost::memory_order_relaxed) != 0)
+    {
+      sample.readers++;
+    }
+    sample.reads += table[i].reads.load(boost::memory_order_relaxed);
+    sample.read_retries += table[i].read_retries.load(boost::memory_order_relaxed);
+    sample.overruns += table[i].overruns.load(boost::memory_order_relaxed);
+  }
+
+  if(insideSegment(segment, header->latency.get(), sizeof(LatencyHistogram)))
+  {
+    sample.latency = header->latency->stats();
+  }
+  return true;
+}
+
+//returns false if the interface doesn't exist (yet)
+bool sampleInterface(const std::string& interface_name, std::map<std::string, FieldSample>& samples)
+{
+  samples.clear();
+  boost::shared_ptr<Segment> segment;
+  try
+  {
+    segment.reset(new Segment(boost::interprocess::open_read_only, interface_name.c_str()));
+  }
+  catch(boost::interprocess::interprocess_exception& ex)
+  {
+    return false;
+  }
+
+  FieldDirectory* directory = segment->find_no_lock<FieldDirectory>("field_directory").first;
+  if(directory == NULL)
+  {
+    return true;
+  }
+
+  std::map<std::string, boost::shared_ptr<Segment> > groups;
+  for(unsigned int i = 0; i < SM_MAX_FIELDS; i++)
+  {
+    std::string field_name = copyName(directory->entries[i].field_name);
+    if(field_name.empty())
+    {
+      continue;
+    }
+
+    Segment* field_segment = segment.get();
+    std::string group = copyName(directory->entries[i].group);
+    if(!group.empty())
+    {
+      boost::shared_ptr<Segment>& group_segment = groups[group];
+      if(!group_segment)
+      {
+        try
+        {
+          group_segment.reset(new Segment(boost::interprocess::open_read_only, groupSegmentName(interface_name, group).c_str()));
+        }
+        catch(boost::interprocess::interprocess_exception& ex)
+        {
+          continue; //its creator hasn't gotten that far yet
+        }
+      }
+      field_segment = group_segment.get();
+    }
+
+    FieldSample sample;
+    if(sampleField(*field_segment, directory->entries[i].header, sample))
+    {
+      samples[field_name] = sample;
+    }
+  }
+  return true;
+}
+
+double microseconds(uint64_t ns)
+{
+  return ns / 1000.0;
+}
+
+void printTable(const std::string& interface_name, const std::map<std::string, FieldSample>& previous, const std::map<std::string, FieldSample>& current, double period)
+{
+  if(isatty(STDOUT_FILENO))
+  {
+    printf("\033[H\033[2J");
+  }
+  else
+  {
+    printf("\n"); //keeps the tables apart when the output goes to a file
+  }
+  printf("interface \"%s\", %lu fields, refreshing every %gs\n\n", interface_name.c_str(), (unsigned long) current.size(), period);
+  printf("%-32s %10s %10s %9s %5s %5s %10s %9s %9s %9s %8s %8s %8s %8s  %s\n", "FIELD", "MSG/S", "MB/S", "AVG SIZE", "SLOTS", "SUBS", "READS/S", "RETRIES/S", "OVERRUNS", "WAITS", "P50 US", "P99 US", "MAX US", "AGE S", "TYPE");
+  for(std::map<std::string, FieldSample>::const_iterator field = current.begin(); field != current.end(); field++)
+  {
+    const FieldSample& now = field->second;
+    FieldSample before = now; //a new field starts from zero rates
+    std::map<std::string, FieldSample>::const_iterator old = previous.find(field->first);
+    if(old != previous.end() && old->second.messages <= now.messages) //otherwise the field was recreated
+    {
+      before = old->second;
+    }
+
+    uint32_t messages = now.messages - before.messages;
+    uint64_t bytes = now.bytes - before.bytes;
+    printf("%-32s %10.1f %10.2f %9.0f %5u %5u %10.1f %9.1f %9lu %9u %8.1f %8.1f %8.1f %8.1f  %s\n", field->first.c_str(), messages / period, bytes / period / (1024.0 * 1024.0), messages? (double) bytes / messages : 0.0, now.num_slots, now.readers, (now.reads - before.reads) / period, (now.read_retries - before.read_retries) / period, (unsigned long) now.overruns, now.writer_waits, microseconds(now.latency.p50), microseconds(now.latency.p99), microseconds(now.latency.max), now.messages? now.age_ns / 1e9 : 0.0, now.datatype.c_str());
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+  std::string interface_name = "smi";
+  double period = 1.0;
+
+  if(argc >= 2)
+  {
+    interface_name = std::string(argv[1]);
+  }
+  if(argc >= 3)
+  {
+    period = std::max(atof(argv[2]), 0.1);
+  }
+
+  std::map<std::string, FieldSample> previous;
+  std::map<std::string, FieldSample> current;
+  sampleInterface(interface_name, previous);
+  while(true)
+  {
+    usleep((useconds_t) (period * 1e6));
+    if(!sampleInterface(interface_name, current))
+    {
+      fprintf(stderr, "Waiting for shared interface \"%s\"...\n", interface_name.c_str());
+      previous.clear();
+      continue;
+    }
+    printTable(interface_name, previous, current, period);
+    previous.swap(current);
+  }
+
+  return 0;
+}
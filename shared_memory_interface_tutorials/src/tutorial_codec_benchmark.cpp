@@ -0,0 +1,139 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ros/ros.h"
+#include "shared_memory_interface/shared_memory_publisher.hpp"
+#include "shared_memory_interface/shared_memory_subscriber.hpp"
+#include <std_msgs/Float64.h>
+#include <std_msgs/Float64MultiArray.h>
+
+// Isolates what the message codec costs per message. A fixed-size type (std_msgs/Float64) is copied into its slot as a
+// raw blob, while a one-element std_msgs/Float64MultiArray carries the same value through ROS serialization. Both are
+// published and read back NUM_ITERATIONS times within this process, so there is no scheduler or wakeup in the way
+// (unlike tutorial_rtt_master/slave). The benchmark creates (and destroys) its own interface, so no manager is needed.
+
+#define WRITE_TO_ROS_TOPIC false
+#define LISTEN_TO_ROS_TOPIC false
+
+int NUM_ITERATIONS = 2000000; //Default Value
+int NUM_RUNS = 3; //Default Value
+
+void setValue(std_msgs::Float64& msg, double value)
+{
+  msg.data = value;
+}
+
+void setValue(std_msgs::Float64MultiArray& msg, double value)
+{
+  msg.data.resize(1);
+  msg.data[0] = value;
+}
+
+double getValue(const std_msgs::Float64& msg)
+{
+  return msg.data;
+}
+
+double getValue(const std_msgs::Float64MultiArray& msg)
+{
+  return msg.data.empty()? -1.0 : msg.data[0];
+}
+
+//returns the nanoseconds one publish plus one read back took on average
+template<typename T>
+double runBenchmark(std::string interface_name, std::string topic)
+{
+  shared_memory_interface::Publisher<T> pub(WRITE_TO_ROS_TOPIC);
+  pub.setIntraProcess(false); //the point is to go through the slots
+  pub.advertise(topic, interface_name, 1);
+  shared_memory_interface::Subscriber<T> sub(LISTEN_TO_ROS_TOPIC);
+  sub.setIntraProcess(false);
+  sub.subscribe(topic, interface_name);
+
+  T msg;
+  T received;
+  int lost = 0;
+  ros::WallTime start = ros::WallTime::now();
+  for(int i = 0; i < NUM_ITERATIONS && ros::ok(); i++)
+  {
+    setValue(msg, i);
+    pub.publish(msg);
+    if(!sub.getCurrentMessage(received) || getValue(received) != i)
+    {
+      lost++;
+    }
+  }
+  double seconds = (ros::WallTime::now() - start).toSec();
+  if(lost != 0)
+  {
+    ROS_ERROR_STREAM("Lost " << lost << " messages on " << topic << "!");
+  }
+  return seconds * 1e9 / NUM_ITERATIONS;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc == 3)
+  {
+    NUM_ITERATIONS = atoi(argv[1]);
+    NUM_RUNS = atoi(argv[2]);
+  }
+  else if(argc != 1)
+  {
+    std::cout << "Accept TWO arguments: NUM_ITERATIONS & NUM_RUNS\n"
+              << "  - NUM_ITERATIONS: The number of messages to publish and read back per run.\n"
+              << "  - NUM_RUNS: The number of times to repeat the comparison."
+              << std::endl;
+    return 1;
+  }
+
+  ros::init(argc, argv, "codec_benchmark", ros::init_options::AnonymousName);
+  ros::NodeHandle n;
+
+  std::string interface_name = "smi_codec_benchmark";
+  if(!shared_memory_interface::createMemory(interface_name, 16 * 1024 * 1024))
+  {
+    ROS_ERROR_STREAM("Couldn't create " << interface_name << "!");
+    return 1;
+  }
+
+  for(int run = 0; run < NUM_RUNS && ros::ok(); run++)
+  {
+    double serialized_ns = runBenchmark<std_msgs::Float64MultiArray>(interface_name, "/codec_benchmark_serialized");
+    double fixed_ns = runBenchmark<std_msgs::Float64>(interface_name, "/codec_benchmark_fixed");
+    ROS_INFO_STREAM("Codec benchmark run " << run + 1 << " of " << NUM_RUNS << ", " << NUM_ITERATIONS << " messages:\n"
+      << " - Serialized (Float64MultiArray, 1 value), ns per message: " << serialized_ns << "\n"
+      << " - Fixed size (Float64), ns per message: " << fixed_ns);
+  }
+
+  shared_memory_interface::destroyMemory(interface_name);
+  return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ros/ros.h"
+#include "shared_memory_interface/shared_memory_publisher.hpp"
+#include "shared_memory_interface/shared_memory_subscriber.hpp"
+#include <std_msgs/UInt8MultiArray.h>
+#include <sys/resource.h>
+
+// Compares a segment backed by regular 4 KB pages with one backed by transparent huge pages. For each, a large
+// UInt8MultiArray is published and read back NUM_ITERATIONS times, and we report the minor page faults this took along
+// with the resulting copy throughput. The benchmark creates (and destroys) its own interfaces, so no manager is needed.
+
+#define WRITE_TO_ROS_TOPIC false
+#define LISTEN_TO_ROS_TOPIC false
+
+int PAYLOAD_MB = 8; //Default Value
+int NUM_ITERATIONS = 200; //Default Value
+
+long minorFaults()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_minflt;
+}
+
+void runBenchmark(std::string interface_name, bool use_huge_pages)
+{
+  unsigned long payload_size = PAYLOAD_MB * 1024 * 1024;
+  if(!shared_memory_interface::createMemory(interface_name, 6 * payload_size + 16 * 1024 * 1024, use_huge_pages))
+  {
+    ROS_ERROR_STREAM("Couldn't create " << interface_name << "!");
+    return;
+  }
+
+  long faults_before = minorFaults();
+  ros::WallTime start = ros::WallTime::now();
+  unsigned long huge_bytes = 0;
+  {
+    shared_memory_interface::Publisher<std_msgs::UInt8MultiArray> pub(WRITE_TO_ROS_TOPIC);
+    pub.advertise("/huge_page_benchmark", interface_name, 1);
+    shared_memory_interface::Subscriber<std_msgs::UInt8MultiArray> sub(LISTEN_TO_ROS_TOPIC);
+    sub.subscribe("/huge_page_benchmark", interface_name);
+
+    std_msgs::UInt8MultiArray msg;
+    std_msgs::UInt8MultiArray received;
+    msg.data.resize(payload_size, 0);
+    for(int i = 0; i < NUM_ITERATIONS && ros::ok(); i++)
+    {
+      msg.data[i % payload_size] = i;
+      pub.publish(msg);
+      if(!sub.getCurrentMessage(received) || received.data.size() != payload_size)
+      {
+        ROS_ERROR("Lost a message!");
+      }
+    }
+
+    boost::shared_ptr<shared_memory_interface::SegmentHandle> handle = shared_memory_interface::SegmentRegistry::acquire(interface_name);
+    huge_bytes = shared_memory_interface::hugePageBytesMapped(handle->segment()->get_address());
+  }
+  double seconds = (ros::WallTime::now() - start).toSec();
+  long faults = minorFaults() - faults_before;
+
+  ROS_INFO_STREAM((use_huge_pages? "Huge" : "Regular") << " page statistics:\n"
+    << " - Payload (MB): " << PAYLOAD_MB << "\n"
+    << " - Iterations: " << NUM_ITERATIONS << "\n"
+    << " - Minor page faults: " << faults << "\n"
+    << " - Segment bytes mapped with huge pages: " << huge_bytes << "\n"
+    << " - Throughput, written and read back (GB/s): " << 2.0 * payload_size * NUM_ITERATIONS / seconds / 1e9);
+
+  shared_memory_interface::destroyMemory(interface_name);
+}
+
+int main(int argc, char **argv)
+{
+  if(argc == 3)
+  {
+    PAYLOAD_MB = atoi(argv[1]);
+    NUM_ITERATIONS = atoi(argv[2]);
+  }
+  else if(argc != 1)
+  {
+    std::cout << "Accept TWO arguments: PAYLOAD_MB & NUM_ITERATIONS\n"
+              << "  - PAYLOAD_MB: The size of each message, in megabytes.\n"
+              << "  - NUM_ITERATIONS: The number of messages to publish and read back."
+              << std::endl;
+    return 1;
+  }
+
+  ros::init(argc, argv, "huge_page_benchmark", ros::init_options::AnonymousName);
+  ros::NodeHandle n;
+
+  ROS_INFO_STREAM("/dev/shm is mounted with huge=" << shared_memory_interface::sharedMemoryMountHugeOption() << ", transparent huge pages for shmem are set to \"" << shared_memory_interface::transparentHugePageShmemMode() << "\"");
+  runBenchmark("smi_huge_page_benchmark_regular", false);
+  runBenchmark("smi_huge_page_benchmark_huge", true);
+  return 0;
+}
@@ -40,7 +40,7 @@
 #define USE_POLLING false
 #define WRITE_TO_ROS_TOPIC false
 #define NUM_TRANSMIT_TIMES 1
-#define PRE_PUBLISH true // must match value in tutorial_init_latency_test_robot
+#define PREFAULT shared_memory_interface::PrefaultPolicy::FIELD // fault in each topic's memory up front instead of on its first message
 
 // Declare the messages to transmit
 std_msgs::Float64 msg1, msg2;
@@ -119,7 +119,9 @@ int main(int argc, char **argv)
     ros::NodeHandle nh;
   
     // Initialize the publishers
+    pub1.setPrefaultPolicy(PREFAULT);
     pub1.advertise("/controller1");
+    pub2.setPrefaultPolicy(PREFAULT);
     pub2.advertise("/controller2");
   
     // Declare three subscribers
@@ -127,22 +129,13 @@ int main(int argc, char **argv)
     shared_memory_interface::Subscriber<std_msgs::Float64> sub2(LISTEN_TO_ROS_TOPIC, USE_POLLING);
     shared_memory_interface::Subscriber<std_msgs::Float64> sub3(LISTEN_TO_ROS_TOPIC, USE_POLLING);
     
+    sub1.setPrefaultPolicy(PREFAULT);
     sub1.subscribe("/robot1", boost::bind(&callback1, _1));
+    sub2.setPrefaultPolicy(PREFAULT);
     sub2.subscribe("/robot2", boost::bind(&callback2, _1));
+    sub3.setPrefaultPolicy(PREFAULT);
     sub3.subscribe("/robot3", boost::bind(&callback3, _1));
-  
-    if (PRE_PUBLISH)
-    {
-        doneRcvCnt = 2;
-        ROS_INFO("Controller: Pre-publishing messages...");
-        if (!publishMsgs())
-            return -1;
-    }
-    else
-    {
-        ROS_INFO("Controller: NOT pre-publishing messages...");
-    }
-  
+    
     // Wait for user input
     // ROS_INFO("Controller: Press any key to start publishing...");
     // getchar();
@@ -37,7 +37,7 @@
 
 #define WRITE_TO_ROS_TOPIC false
 #define NUM_TRANSMIT_TIMES 1
-#define PRE_PUBLISH false // must match value in tutorial_init_latency_test_subscriber
+#define PREFAULT shared_memory_interface::PrefaultPolicy::FIELD // fault in each topic's memory up front instead of on its first message
 
 // Declare the messages to transmit
 std_msgs::Float64 msg1, msg2, msg3;
@@ -75,21 +75,13 @@ int main(int argc, char **argv)
     ros::init(argc, argv, "publisher", ros::init_options::AnonymousName);
     ros::NodeHandle nh;
 
+    pub1.setPrefaultPolicy(PREFAULT);
     pub1.advertise("/topic1");
+    pub2.setPrefaultPolicy(PREFAULT);
     pub2.advertise("/topic2");
+    pub3.setPrefaultPolicy(PREFAULT);
     pub3.advertise("/topic3");
 
-    if (PRE_PUBLISH)
-    {
-        ROS_INFO("Publisher: Pre-publishing messages...");
-        if (!publishMsgs())
-            return -1;
-    }
-    else
-    {
-        ROS_INFO("Publisher: NOT pre-publishing messages...");
-    }
-
     // Wait for user input
     ROS_INFO("Press any key to start publishing...");
     getchar();
@@ -41,7 +41,7 @@
 #define USE_POLLING false
 #define WRITE_TO_ROS_TOPIC false
 #define NUM_TRANSMIT_TIMES 1
-#define PRE_PUBLISH true // must match value in tutorial_init_latency_test_controller
+#define PREFAULT shared_memory_interface::PrefaultPolicy::FIELD // fault in each topic's memory up front instead of on its first message
 
 // Declare the messages to transmit
 std_msgs::Float64 msg1, msg2, msg3;
@@ -117,29 +117,22 @@ int main(int argc, char **argv)
     ros::NodeHandle nh;
 
     // Initialize the publishers
+    pub1.setPrefaultPolicy(PREFAULT);
     pub1.advertise("/robot1");
+    pub2.setPrefaultPolicy(PREFAULT);
     pub2.advertise("/robot2");
+    pub3.setPrefaultPolicy(PREFAULT);
     pub3.advertise("/robot3");
 
     // Declare three subscribers
     shared_memory_interface::Subscriber<std_msgs::Float64> sub1(LISTEN_TO_ROS_TOPIC, USE_POLLING);
     shared_memory_interface::Subscriber<std_msgs::Float64> sub2(LISTEN_TO_ROS_TOPIC, USE_POLLING);
 
+    sub1.setPrefaultPolicy(PREFAULT);
     sub1.subscribe("/controller1", boost::bind(&callback1, _1));
+    sub2.setPrefaultPolicy(PREFAULT);
     sub2.subscribe("/controller2", boost::bind(&callback2, _1));
 
-    if (PRE_PUBLISH)
-    {
-        doneRcvCnt = 2;
-        ROS_INFO("Robot: Pre-publishing messages...");
-        if (!publishMsgs())
-            return -1;
-    }
-    else
-    {
-        ROS_INFO("Robot: NOT pre-publishing messages...");
-    }
-
     // Wait for user input
     ROS_INFO("Robot: Press any key to start publishing...");
     getchar();
@@ -35,7 +35,7 @@
 
 #define LISTEN_TO_ROS_TOPIC false
 #define USE_POLLING false
-#define PRE_PUBLISH false // must match value in tutorial_init_latency_test_publisher
+#define PREFAULT shared_memory_interface::PrefaultPolicy::FIELD // fault in each topic's memory up front instead of on its first message
 
 // Declare variables for holding receive state
 int rcvCnt1 = 0, rcvCnt2 = 0, rcvCnt3 = 0;
@@ -91,16 +91,16 @@ int main(int argc, char **argv)
     ros::init(argc, argv, "subscriber", ros::init_options::AnonymousName);
     ros::NodeHandle nh;
 
-    if (PRE_PUBLISH)
-        doneRcvCnt = 2;
-
   // Declare three subscribers
   shared_memory_interface::Subscriber<std_msgs::Float64> sub1(LISTEN_TO_ROS_TOPIC, USE_POLLING);
   shared_memory_interface::Subscriber<std_msgs::Float64> sub2(LISTEN_TO_ROS_TOPIC, USE_POLLING);
   shared_memory_interface::Subscriber<std_msgs::Float64> sub3(LISTEN_TO_ROS_TOPIC, USE_POLLING);
   
+  sub1.setPrefaultPolicy(PREFAULT);
   sub1.subscribe("/topic1", boost::bind(&callback1, _1));
+  sub2.setPrefaultPolicy(PREFAULT);
   sub2.subscribe("/topic2", boost::bind(&callback2, _1));
+  sub3.setPrefaultPolicy(PREFAULT);
   sub3.subscribe("/topic3", boost::bind(&callback3, _1));
 
   ros::Rate loop_rate(1000);
@@ -0,0 +1,160 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ros/ros.h"
+#include "shared_memory_interface/shared_memory_publisher.hpp"
+#include "shared_memory_interface/shared_memory_subscriber.hpp"
+#include <std_msgs/UInt8MultiArray.h>
+
+// Streams 4K RGB frames through an interface bigger than 4 GB. NUM_STREAMS topics share the interface, each with a
+// queue deep enough that together they take up most of it, so the slot buffers end up well past the 4 GB mark. Every
+// round fills each queue completely and then reads it back, checking that every frame arrives intact and in order.
+// The test creates (and destroys) its own interface, so no manager is needed. Make sure /dev/shm has room for it.
+
+#define WRITE_TO_ROS_TOPIC false
+#define LISTEN_TO_ROS_TOPIC false
+#define FRAME_SIZE (3840 * 2160 * 3)
+
+double SEGMENT_GB = 6.0; //Default Value
+int NUM_STREAMS = 4; //Default Value
+int NUM_ROUNDS = 3; //Default Value
+
+void stampFrame(std_msgs::UInt8MultiArray& frame, uint64_t number)
+{
+  memcpy(&frame.data[0], &number, sizeof(number));
+  frame.data[frame.data.size() / 2] = number;
+  frame.data[frame.data.size() - 1] = number;
+}
+
+bool checkFrame(const std_msgs::UInt8MultiArray& frame, uint64_t number)
+{
+  uint64_t stamp;
+  if(frame.data.size() != FRAME_SIZE)
+  {
+    return false;
+  }
+  memcpy(&stamp, &frame.data[0], sizeof(stamp));
+  return stamp == number && frame.data[frame.data.size() / 2] == (uint8_t) number && frame.data[frame.data.size() - 1] == (uint8_t) number;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc == 4)
+  {
+    SEGMENT_GB = atof(argv[1]);
+    NUM_STREAMS = atoi(argv[2]);
+    NUM_ROUNDS = atoi(argv[3]);
+  }
+  else if(argc != 1)
+  {
+    std::cout << "Accept THREE arguments: SEGMENT_GB & NUM_STREAMS & NUM_ROUNDS\n"
+              << "  - SEGMENT_GB: The size of the interface, in gigabytes. Should be more than 4.\n"
+              << "  - NUM_STREAMS: The number of topics streaming frames through it.\n"
+              << "  - NUM_ROUNDS: How many times each topic's queue is filled and drained."
+              << std::endl;
+    return 1;
+  }
+
+  ros::init(argc, argv, "large_segment_test", ros::init_options::AnonymousName);
+  ros::NodeHandle n;
+
+  std::string interface_name = "smi_large_segment";
+  uint64_t segment_size = (uint64_t) (SEGMENT_GB * 1024 * 1024 * 1024);
+  if(!shared_memory_interface::createMemory(interface_name, segment_size))
+  {
+    ROS_ERROR_STREAM("Couldn't create " << interface_name << "!");
+    return 1;
+  }
+
+  //leave a tenth of the segment for the bookkeeping, and for the small slots each field starts out with
+  unsigned int queue_size = (unsigned int) (segment_size * 0.9 / NUM_STREAMS / FRAME_SIZE) - 1;
+  ROS_INFO_STREAM("Streaming " << NUM_STREAMS << " topics with queues of " << queue_size << " frames through " << segment_size << " bytes");
+
+  bool success = true;
+  uint64_t frames_checked = 0;
+  ros::WallTime start = ros::WallTime::now();
+  {
+    std::vector<boost::shared_ptr<shared_memory_interface::Publisher<std_msgs::UInt8MultiArray> > > pubs;
+    std::vector<boost::shared_ptr<shared_memory_interface::Subscriber<std_msgs::UInt8MultiArray> > > subs;
+    for(int i = 0; i < NUM_STREAMS; i++)
+    {
+      std::stringstream topic;
+      topic << "/camera" << i;
+      pubs.push_back(boost::shared_ptr<shared_memory_interface::Publisher<std_msgs::UInt8MultiArray> >(new shared_memory_interface::Publisher<std_msgs::UInt8MultiArray>(WRITE_TO_ROS_TOPIC)));
+      pubs.back()->advertise(topic.str(), interface_name, queue_size);
+      subs.push_back(boost::shared_ptr<shared_memory_interface::Subscriber<std_msgs::UInt8MultiArray> >(new shared_memory_interface::Subscriber<std_msgs::UInt8MultiArray>(LISTEN_TO_ROS_TOPIC)));
+      subs.back()->subscribe(topic.str(), interface_name);
+    }
+
+    std_msgs::UInt8MultiArray frame;
+    std_msgs::UInt8MultiArray received;
+    frame.data.resize(FRAME_SIZE, 0);
+    uint64_t next_frame = 1;
+    for(int round = 0; round < NUM_ROUNDS && success && ros::ok(); round++)
+    {
+      uint64_t first_frame = next_frame;
+      for(unsigned int i = 0; i < queue_size; i++, next_frame++)
+      {
+        stampFrame(frame, next_frame);
+        for(int stream = 0; stream < NUM_STREAMS; stream++)
+        {
+          success = pubs[stream]->publish(frame) && success;
+        }
+      }
+
+      for(int stream = 0; stream < NUM_STREAMS && success; stream++)
+      {
+        for(uint64_t number = first_frame; number < next_frame; number++)
+        {
+          if(!subs[stream]->waitForMessage(received, 1000) || !checkFrame(received, number))
+          {
+            ROS_ERROR_STREAM("Frame " << number << " on stream " << stream << " was lost or corrupted!");
+            success = false;
+            break;
+          }
+          frames_checked++;
+        }
+      }
+
+      boost::shared_ptr<shared_memory_interface::SegmentHandle> handle = shared_memory_interface::SegmentRegistry::acquire(interface_name);
+      ROS_INFO_STREAM("Round " << round << ": " << (segment_size - handle->segment()->get_free_memory()) << " bytes of the segment in use");
+    }
+  }
+  double seconds = (ros::WallTime::now() - start).toSec();
+
+  ROS_INFO_STREAM("Large segment test " << (success? "passed" : "FAILED") << ":\n"
+    << " - Segment size (bytes): " << segment_size << "\n"
+    << " - Frames checked: " << frames_checked << "\n"
+    << " - Throughput, written and read back (GB/s): " << 2.0 * FRAME_SIZE * frames_checked / seconds / 1e9);
+
+  shared_memory_interface::destroyMemory(interface_name);
+  return success? 0 : 1;
+}
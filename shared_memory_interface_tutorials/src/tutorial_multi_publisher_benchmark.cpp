@@ -0,0 +1,179 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ros/ros.h"
+#include "shared_memory_interface/shared_memory_publisher.hpp"
+#include "shared_memory_interface/shared_memory_subscriber.hpp"
+#include <std_msgs/Float64MultiArray.h>
+
+// Measures publish throughput with 1, 2, 4 and 8 publishers writing to the same topic at once, each from its own thread
+// with its own Publisher. Every message is stamped with its writer and that writer's counter in layout.data_offset and in
+// every element of data, so a polling reader can catch torn messages (two publishers writing the same slot) and messages
+// from one writer arriving out of order. The benchmark creates (and destroys) its own interface, so no manager is needed.
+
+#define WRITE_TO_ROS_TOPIC false
+#define LISTEN_TO_ROS_TOPIC false
+#define QUEUE_SIZE 16
+#define MAX_WRITERS 8
+
+int NUM_MESSAGES = 200000; //Default Value, per writer
+int MESSAGE_SIZE = 16; //Default Value
+
+boost::atomic<bool> done(false);
+boost::atomic<unsigned long> num_reads(0);
+boost::atomic<unsigned long> num_torn(0);
+boost::atomic<unsigned long> num_out_of_order(0);
+
+unsigned int stamp(unsigned int writer, unsigned int counter)
+{
+  return counter * MAX_WRITERS + writer;
+}
+
+void writer(std::string interface_name, unsigned int id, boost::barrier* start)
+{
+  shared_memory_interface::Publisher<std_msgs::Float64MultiArray> pub(WRITE_TO_ROS_TOPIC);
+  pub.advertise("/multi_publisher_benchmark", interface_name, QUEUE_SIZE);
+
+  std_msgs::Float64MultiArray msg;
+  msg.data.resize(MESSAGE_SIZE);
+  start->wait();
+  for(int i = 1; i <= NUM_MESSAGES && ros::ok(); i++)
+  {
+    msg.layout.data_offset = stamp(id, i);
+    msg.data.assign(MESSAGE_SIZE, msg.layout.data_offset);
+    pub.publish(msg);
+  }
+}
+
+void reader(std::string interface_name)
+{
+  shared_memory_interface::Subscriber<std_msgs::Float64MultiArray> sub(LISTEN_TO_ROS_TOPIC);
+  sub.subscribe("/multi_publisher_benchmark", interface_name);
+
+  unsigned int last_counter[MAX_WRITERS] = {0};
+  std_msgs::Float64MultiArray msg;
+  while(ros::ok() && !done)
+  {
+    if(!sub.getCurrentMessage(msg))
+    {
+      continue;
+    }
+    num_reads++;
+    bool torn = (msg.data.size() != (unsigned int) MESSAGE_SIZE);
+    for(unsigned int i = 0; !torn && i < msg.data.size(); i++)
+    {
+      torn = (msg.data[i] != msg.layout.data_offset);
+    }
+    if(torn)
+    {
+      num_torn++;
+      continue;
+    }
+    unsigned int id = msg.layout.data_offset % MAX_WRITERS;
+    unsigned int counter = msg.layout.data_offset / MAX_WRITERS;
+    if(counter < last_counter[id])
+    {
+      num_out_of_order++;
+    }
+    last_counter[id] = counter;
+  }
+}
+
+void runBenchmark(std::string interface_name, unsigned int num_writers)
+{
+  if(!shared_memory_interface::createMemory(interface_name, 64 * 1024 * 1024))
+  {
+    ROS_ERROR_STREAM("Couldn't create " << interface_name << "!");
+    return;
+  }
+
+  done = false;
+  num_reads = 0;
+  boost::barrier start(num_writers + 1);
+  boost::thread_group writers;
+  for(unsigned int i = 0; i < num_writers; i++)
+  {
+    writers.create_thread(boost::bind(&writer, interface_name, i, &start));
+  }
+  start.wait(); //all publishers are connected
+  boost::thread polling_reader(boost::bind(&reader, interface_name));
+
+  ros::WallTime start_time = ros::WallTime::now();
+  writers.join_all();
+  double seconds = (ros::WallTime::now() - start_time).toSec();
+  done = true;
+  polling_reader.join();
+
+  unsigned long total = (unsigned long) num_writers * NUM_MESSAGES;
+  ROS_INFO_STREAM(num_writers << " publisher statistics:\n"
+    << " - Messages published: " << total << "\n"
+    << " - Throughput (messages/s): " << total / seconds << "\n"
+    << " - Mean time per publish (ns): " << seconds * 1e9 / total << "\n"
+    << " - Reads checked: " << num_reads);
+
+  shared_memory_interface::destroyMemory(interface_name);
+}
+
+int main(int argc, char **argv)
+{
+  if(argc == 3)
+  {
+    NUM_MESSAGES = atoi(argv[1]);
+    MESSAGE_SIZE = atoi(argv[2]);
+  }
+  else if(argc != 1)
+  {
+    std::cout << "Accept TWO arguments: NUM_MESSAGES & MESSAGE_SIZE\n"
+              << "  - NUM_MESSAGES: The number of messages each publisher writes.\n"
+              << "  - MESSAGE_SIZE: The number of doubles in each message."
+              << std::endl;
+    return 1;
+  }
+
+  ros::init(argc, argv, "multi_publisher_benchmark", ros::init_options::AnonymousName);
+  ros::NodeHandle n;
+
+  for(unsigned int num_writers = 1; num_writers <= MAX_WRITERS && ros::ok(); num_writers *= 2)
+  {
+    runBenchmark("smi_multi_publisher_benchmark", num_writers);
+  }
+
+  ROS_INFO_STREAM("Multi publisher statistics:\n"
+    << " - Torn reads: " << num_torn << "\n"
+    << " - Out of order reads from one publisher: " << num_out_of_order);
+  if(num_torn != 0 || num_out_of_order != 0)
+  {
+    ROS_ERROR("Multi publisher benchmark FAILED!");
+    return 1;
+  }
+  ROS_INFO("Multi publisher benchmark passed.");
+  return 0;
+}
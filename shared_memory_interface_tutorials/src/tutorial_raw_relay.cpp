@@ -0,0 +1,81 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ros/ros.h"
+#include "shared_memory_interface/shared_memory_publisher.hpp"
+#include "shared_memory_interface/shared_memory_subscriber.hpp"
+
+// Forwards a topic from one interface to another without knowing its type: the serialized bytes are handed from the
+// subscriber's callback straight to the publisher, and are never deserialized.
+//   rosrun shared_memory_interface_tutorials tutorial_raw_relay /chatter smi smi_relay
+
+#define WRITE_TO_ROS_TOPIC false
+#define LISTEN_TO_ROS_TOPIC false
+
+shared_memory_interface::Publisher<shared_memory_interface::RawMessage>* relay;
+unsigned long relayed_bytes = 0;
+
+void relayCallback(shared_memory_interface::RawMessage& msg)
+{
+  if(relayed_bytes == 0)
+  {
+    ROS_INFO_STREAM("Relaying " << msg.datatype << " messages (md5sum " << msg.md5sum << ")");
+  }
+  relay->publish(msg);
+  relayed_bytes += msg.length;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc != 4)
+  {
+    std::cout << "Accept THREE arguments: TOPIC SOURCE_INTERFACE DESTINATION_INTERFACE\n"
+              << "  - TOPIC: The topic to relay.\n"
+              << "  - SOURCE_INTERFACE: The shared memory interface to read it from.\n"
+              << "  - DESTINATION_INTERFACE: The shared memory interface to publish it to."
+              << std::endl;
+    return 1;
+  }
+
+  ros::init(argc, argv, "raw_relay", ros::init_options::AnonymousName);
+  ros::NodeHandle n;
+
+  relay = new shared_memory_interface::Publisher<shared_memory_interface::RawMessage>(WRITE_TO_ROS_TOPIC);
+  relay->advertise(argv[1], argv[3], 16);
+
+  shared_memory_interface::Subscriber<shared_memory_interface::RawMessage> sub(LISTEN_TO_ROS_TOPIC);
+  sub.subscribe(argv[1], boost::bind(&relayCallback, _1), argv[2]);
+
+  ros::spin();
+  ROS_INFO_STREAM("Relayed " << relayed_bytes << " bytes");
+  delete relay;
+  return 0;
+}
@@ -32,6 +32,7 @@
 #include "ros/ros.h"
 #include "shared_memory_interface/shared_memory_publisher.hpp"
 #include "shared_memory_interface/shared_memory_subscriber.hpp"
+#include "std_msgs/Float64.h"
 #include "std_msgs/Float64MultiArray.h"
 #include "std_msgs/MultiArrayDimension.h"
 
@@ -41,6 +42,7 @@
 
 int NUM_SAMPLES = 10000; //Default Value
 int SIZE_SAMPLES = 1; //Default Value
+bool FIXED_SIZE = false; //Default Value
 double *data;
 
 int dataIndex = 0;
@@ -48,6 +50,7 @@ bool firstRound = true; // keep track of first round so that we can ignore it
 bool roundDone = true;
 
 ros::Time sendTime;
+boost::function<shared_memory_interface::LatencyStats()> getOneWayStats; // of the slave's reply leg, as recorded by the field
 
 void printStats()
 {
@@ -71,20 +74,24 @@ void printStats()
 
   variance /= NUM_SAMPLES;
   double stdev = sqrt(variance);
+  shared_memory_interface::LatencyStats oneWay = getOneWayStats();
 
   ROS_INFO_STREAM("RTT Benchmark statistics:\n"
+    << " - Message type: " << (FIXED_SIZE? "std_msgs/Float64 (fixed size)" : "std_msgs/Float64MultiArray (serialized)") << "\n"
     << " - Num samples: " << NUM_SAMPLES << "\n"
     << " - Size samples: "<<SIZE_SAMPLES << "\n"
     << " - Average (us): " << avg << "\n" 
     << " - Standard deviation: " << stdev << "\n"
     << " - Min (us): " << min << "\n"
-    << " - Max (us): " << max);
+    << " - Max (us): " << max << "\n"
+    << " - One-way p50 / p99 / p99.9 / max (us): " << oneWay.p50 / 1e3 << " / " << oneWay.p99 / 1e3 << " / " << oneWay.p999 / 1e3 << " / " << oneWay.max / 1e3);
 
   delete [] data;
   ros::shutdown();
 }
 
-void rttRxCallback(std_msgs::Float64MultiArray& msg)
+template<typename T>
+void rttRxCallback(T& msg)
 {
   if (!firstRound && dataIndex < NUM_SAMPLES)
   {
@@ -102,25 +109,61 @@ void rttRxCallback(std_msgs::Float64MultiArray& msg)
   roundDone = true; // triggers the sending of the next RTT number
 }
 
+template<typename T>
+void runBenchmark(T& msg, std::string tx_topic, std::string rx_topic)
+{
+  shared_memory_interface::Publisher<T> pub(WRITE_TO_ROS_TOPIC);
+  pub.advertise(tx_topic);
+
+  shared_memory_interface::Subscriber<T> sub(LISTEN_TO_ROS_TOPIC, USE_POLLING);
+  getOneWayStats = boost::bind(&shared_memory_interface::Subscriber<T>::getLatencyStats, &sub);
+  sub.subscribe(rx_topic, boost::bind(&rttRxCallback<T>, _1));
+
+  ros::Rate loop_rate(1000);
+  while (ros::ok())
+  {
+    if (roundDone)
+    {
+      roundDone = false;
+      sendTime = ros::Time::now();
+      if (!pub.publish(msg))
+      {
+        ROS_ERROR("Master: Failed to publish message. Aborting.");
+        break;
+      }
+    }
+    loop_rate.sleep();
+  }
+  ros::spin();
+}
+
 int main(int argc, char **argv)
 {
 
   if (argc != 1)
   {
-    if (argc == 3)
+    if (argc == 3 || (argc == 4 && std::string(argv[3]) == "fixed"))
     {
       // Change the NUM_SAMPLES by reading the argument
       NUM_SAMPLES = atoll(argv[1]);
       SIZE_SAMPLES = atoll(argv[2]);
+      FIXED_SIZE = (argc == 4);
     }
     else
     {
-      std::cout << "Accept TWO argument: NUM_SAMPLES & SIZE_SAMPLES\n"
+      std::cout << "Accept TWO arguments and an optional third: NUM_SAMPLES SIZE_SAMPLES [fixed]\n"
                 << "  - NUM_SAMPLES: The number of round trip times to measure.\n"
-                << "  - SIZE_SAMPLES: The number of Float64 values to transmit." 
+                << "  - SIZE_SAMPLES: The number of Float64 values to transmit.\n"
+                << "  - fixed: Send a std_msgs/Float64 instead, a fixed-size type that's copied as a raw blob rather\n"
+                << "    than serialized (SIZE_SAMPLES must be 1). Start tutorial_rtt_slave with fixed as well."
                 << std::endl;
       return 1;
     }
+    if (FIXED_SIZE && SIZE_SAMPLES != 1)
+    {
+      std::cout << "A fixed-size message holds exactly one Float64, SIZE_SAMPLES must be 1." << std::endl;
+      return 1;
+    }
   }
   else
   {
@@ -129,38 +172,24 @@ int main(int argc, char **argv)
 
   data = new double[NUM_SAMPLES];
 
-  std_msgs::Float64MultiArray msg;
-  std_msgs::MultiArrayDimension dim;
-  dim.size = SIZE_SAMPLES;
-  dim.stride = SIZE_SAMPLES;
-  msg.layout.data_offset = 0;
-  msg.layout.dim.push_back(dim);
-  msg.data.resize(SIZE_SAMPLES);
-
   ros::init(argc, argv, "master", ros::init_options::AnonymousName);
   ros::NodeHandle n;
 
-  shared_memory_interface::Publisher<std_msgs::Float64MultiArray> pub(WRITE_TO_ROS_TOPIC);
-  pub.advertise("/rtt_tx");
-
-  shared_memory_interface::Subscriber<std_msgs::Float64MultiArray> sub(LISTEN_TO_ROS_TOPIC, USE_POLLING);
-  sub.subscribe("/rtt_rx", boost::bind(&rttRxCallback, _1));
-
-  ros::Rate loop_rate(1000);
-  while (ros::ok())
+  if (FIXED_SIZE)
   {
-    if (roundDone)
-    {
-      roundDone = false;
-      sendTime = ros::Time::now();
-      if (!pub.publish(msg))
-      {
-        ROS_ERROR("Master: Failed to publish message. Aborting.");
-        break;
-      }
-    }
-    loop_rate.sleep();
+    std_msgs::Float64 msg;
+    runBenchmark(msg, "/rtt_fixed_tx", "/rtt_fixed_rx");
+  }
+  else
+  {
+    std_msgs::Float64MultiArray msg;
+    std_msgs::MultiArrayDimension dim;
+    dim.size = SIZE_SAMPLES;
+    dim.stride = SIZE_SAMPLES;
+    msg.layout.data_offset = 0;
+    msg.layout.dim.push_back(dim);
+    msg.data.resize(SIZE_SAMPLES);
+    runBenchmark(msg, "/rtt_tx", "/rtt_rx");
   }
-  ros::spin();
   return 0;
 }
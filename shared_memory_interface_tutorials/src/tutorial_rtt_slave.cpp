@@ -32,33 +32,48 @@
 #include "ros/ros.h"
 #include "shared_memory_interface/shared_memory_publisher.hpp"
 #include "shared_memory_interface/shared_memory_subscriber.hpp"
+#include <std_msgs/Float64.h>
 #include <std_msgs/Float64MultiArray.h>
 
 #define WRITE_TO_ROS_TOPIC false
 #define LISTEN_TO_ROS_TOPIC false
 #define USE_POLLING true
 
-shared_memory_interface::Publisher<std_msgs::Float64MultiArray> pub(WRITE_TO_ROS_TOPIC);
-
-void rttTxCallback(std_msgs::Float64MultiArray& msg)
+template<typename T>
+void rttTxCallback(shared_memory_interface::Publisher<T>* pub, T& msg)
 {
-  pub.publish(msg);
+  pub->publish(msg);
 }
 
-int main(int argc, char **argv)
+template<typename T>
+void runSlave(std::string tx_topic, std::string rx_topic)
 {
-  ros::init(argc, argv, "slave", ros::init_options::AnonymousName);
-  ros::NodeHandle n;
+  shared_memory_interface::Publisher<T> pub(WRITE_TO_ROS_TOPIC);
+  pub.advertise(rx_topic);
 
-  pub.advertise("/rtt_rx");
-
-  shared_memory_interface::Subscriber<std_msgs::Float64MultiArray> sub(LISTEN_TO_ROS_TOPIC, USE_POLLING);
-  sub.subscribe("/rtt_tx", boost::bind(&rttTxCallback, _1));
+  shared_memory_interface::Subscriber<T> sub(LISTEN_TO_ROS_TOPIC, USE_POLLING);
+  sub.subscribe(tx_topic, boost::bind(&rttTxCallback<T>, &pub, _1));
 
   ros::Rate loop_rate(0.1);
   while (ros::ok())
   {
     loop_rate.sleep();
   }
+}
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "slave", ros::init_options::AnonymousName);
+  ros::NodeHandle n;
+
+  // echoes the fixed-size messages of tutorial_rtt_master NUM_SAMPLES 1 fixed instead
+  if (argc == 2 && std::string(argv[1]) == "fixed")
+  {
+    runSlave<std_msgs::Float64>("/rtt_fixed_tx", "/rtt_fixed_rx");
+  }
+  else
+  {
+    runSlave<std_msgs::Float64MultiArray>("/rtt_tx", "/rtt_rx");
+  }
   return 0;
 }
@@ -0,0 +1,174 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ros/ros.h"
+#include "shared_memory_interface/shared_memory_publisher.hpp"
+#include "shared_memory_interface/shared_memory_subscriber.hpp"
+#include <std_msgs/Float64MultiArray.h>
+
+// Hammers one topic with a fast writer and several readers. Every message carries its own sequence number in
+// layout.data_offset and in every element of data, and its length is derived from that number, so any torn read
+// (a copy that mixes two messages) shows up as a mismatch.
+
+#define WRITE_TO_ROS_TOPIC false
+#define LISTEN_TO_ROS_TOPIC false
+#define QUEUE_SIZE 16
+
+int NUM_MESSAGES = 1000000; //Default Value
+int NUM_READERS = 4; //Default Value
+
+boost::atomic<bool> done(false);
+boost::atomic<unsigned long> num_reads(0);
+boost::atomic<unsigned long> num_torn(0);
+boost::atomic<unsigned long> num_out_of_order(0);
+
+unsigned int expectedSize(unsigned int sequence)
+{
+  return 1 + (sequence * 7) % 97;
+}
+
+bool checkMessage(const std_msgs::Float64MultiArray& msg)
+{
+  if(msg.data.size() != expectedSize(msg.layout.data_offset))
+  {
+    return false;
+  }
+  for(unsigned int i = 0; i < msg.data.size(); i++)
+  {
+    if(msg.data[i] != msg.layout.data_offset)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Polls the latest value as fast as possible
+void pollingReader()
+{
+  shared_memory_interface::Subscriber<std_msgs::Float64MultiArray> sub(LISTEN_TO_ROS_TOPIC);
+  sub.setIntraProcess(false);
+  sub.subscribe("/seqlock_stress");
+
+  std_msgs::Float64MultiArray msg;
+  while(ros::ok() && !done)
+  {
+    if(sub.getCurrentMessage(msg))
+    {
+      num_reads++;
+      if(!checkMessage(msg))
+      {
+        num_torn++;
+      }
+    }
+  }
+}
+
+// Receives queued messages, which must also arrive in order
+int last_queued_sequence = -1;
+void queuedCallback(std_msgs::Float64MultiArray& msg)
+{
+  num_reads++;
+  if(!checkMessage(msg))
+  {
+    num_torn++;
+  }
+  if((int) msg.layout.data_offset <= last_queued_sequence)
+  {
+    num_out_of_order++;
+  }
+  last_queued_sequence = msg.layout.data_offset;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc == 3)
+  {
+    NUM_MESSAGES = atoi(argv[1]);
+    NUM_READERS = atoi(argv[2]);
+  }
+  else if(argc != 1)
+  {
+    std::cout << "Accept TWO arguments: NUM_MESSAGES & NUM_READERS\n"
+              << "  - NUM_MESSAGES: The number of messages to publish.\n"
+              << "  - NUM_READERS: The number of threads polling the latest message."
+              << std::endl;
+    return 1;
+  }
+
+  ros::init(argc, argv, "seqlock_stress", ros::init_options::AnonymousName);
+  ros::NodeHandle n;
+
+  //everyone lives in this process, so turn off intra-process delivery or the readers would never touch the shared
+  //memory we're trying to tear
+  shared_memory_interface::Publisher<std_msgs::Float64MultiArray> pub(WRITE_TO_ROS_TOPIC);
+  pub.setIntraProcess(false);
+  pub.advertise("/seqlock_stress", "smi", QUEUE_SIZE);
+
+  std_msgs::Float64MultiArray msg;
+  msg.layout.data_offset = 0;
+  msg.data.resize(expectedSize(0), 0);
+  pub.publish(msg);
+
+  boost::thread_group readers;
+  for(int i = 0; i < NUM_READERS; i++)
+  {
+    readers.create_thread(&pollingReader);
+  }
+  shared_memory_interface::Subscriber<std_msgs::Float64MultiArray> queued_sub(LISTEN_TO_ROS_TOPIC);
+  queued_sub.setIntraProcess(false);
+  queued_sub.subscribe("/seqlock_stress", boost::bind(&queuedCallback, _1));
+  usleep(500000); //let everyone connect
+
+  for(int i = 1; i <= NUM_MESSAGES && ros::ok(); i++)
+  {
+    msg.layout.data_offset = i;
+    msg.data.assign(expectedSize(i), i);
+    pub.publish(msg);
+  }
+
+  done = true;
+  readers.join_all();
+
+  ROS_INFO_STREAM("Seqlock stress statistics:\n"
+    << " - Messages published: " << NUM_MESSAGES << "\n"
+    << " - Reads: " << num_reads << "\n"
+    << " - Torn reads: " << num_torn << "\n"
+    << " - Out of order queued reads: " << num_out_of_order);
+
+  if(num_torn != 0 || num_out_of_order != 0)
+  {
+    ROS_ERROR("Seqlock stress test FAILED!");
+    return 1;
+  }
+  ROS_INFO("Seqlock stress test passed.");
+  return 0;
+}
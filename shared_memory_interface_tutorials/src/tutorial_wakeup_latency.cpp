@@ -0,0 +1,159 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, Joshua James
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ros/ros.h"
+#include "shared_memory_interface/shared_memory_publisher.hpp"
+#include "shared_memory_interface/shared_memory_subscriber.hpp"
+#include <std_msgs/Float64.h>
+#include <algorithm>
+
+// Measures how stale a slow topic can get at its subscriber. A publisher runs at RATE_HZ and every SLOW_EVERY-th
+// callback takes SLOW_MS, so the next message lands while the subscriber is busy. That is exactly the window in which
+// a wait that doesn't check the sequence first misses a wakeup. For every published message we record how long it took
+// until the subscriber had seen it (or anything newer), and report the percentiles. A missed wakeup costs a full
+// publish period, which shows up in the p99.9 and max.
+
+#define WRITE_TO_ROS_TOPIC false
+#define LISTEN_TO_ROS_TOPIC false
+#define QUEUE_SIZE 4
+
+int NUM_MESSAGES = 1000; //Default Value
+double RATE_HZ = 10.0; //Default Value
+int SLOW_EVERY = 7; //Default Value
+int SLOW_MS = 130; //Default Value
+
+std::vector<uint64_t> publish_ns;
+std::vector<uint64_t> seen_ns; //when the subscriber first had message i or a newer one
+boost::atomic<int> newest_seen(-1);
+
+void callback(std_msgs::Float64& msg)
+{
+  uint64_t now = shared_memory_interface::monotonicNanoseconds();
+  int sequence = (int) msg.data;
+  for(int i = newest_seen + 1; i <= sequence && i < NUM_MESSAGES; i++)
+  {
+    seen_ns[i] = now;
+  }
+  if(sequence > newest_seen)
+  {
+    newest_seen = sequence;
+  }
+
+  if(sequence % SLOW_EVERY == 0)
+  {
+    usleep(SLOW_MS * 1000);
+  }
+}
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+  return sorted[std::min(sorted.size() - 1, (size_t) (p * sorted.size()))];
+}
+
+int main(int argc, char **argv)
+{
+  if(argc == 5)
+  {
+    NUM_MESSAGES = atoi(argv[1]);
+    RATE_HZ = atof(argv[2]);
+    SLOW_EVERY = atoi(argv[3]);
+    SLOW_MS = atoi(argv[4]);
+  }
+  else if(argc != 1)
+  {
+    std::cout << "Accept FOUR arguments: NUM_MESSAGES & RATE_HZ & SLOW_EVERY & SLOW_MS\n"
+              << "  - NUM_MESSAGES: The number of messages to publish (p99.9 needs at least 1000).\n"
+              << "  - RATE_HZ: The publish rate.\n"
+              << "  - SLOW_EVERY: Every SLOW_EVERY-th callback is slow.\n"
+              << "  - SLOW_MS: How long a slow callback takes, in milliseconds."
+              << std::endl;
+    return 1;
+  }
+
+  ros::init(argc, argv, "wakeup_latency", ros::init_options::AnonymousName);
+  ros::NodeHandle n;
+  publish_ns.resize(NUM_MESSAGES, 0);
+  seen_ns.resize(NUM_MESSAGES, 0);
+
+  //both ends live in this process, so turn off intra-process delivery or we'd be timing a thread handoff instead of
+  //the shared memory wakeup
+  shared_memory_interface::Publisher<std_msgs::Float64> pub(WRITE_TO_ROS_TOPIC);
+  pub.setIntraProcess(false);
+  pub.advertise("/wakeup_latency", "smi", QUEUE_SIZE);
+  shared_memory_interface::Subscriber<std_msgs::Float64> sub(LISTEN_TO_ROS_TOPIC);
+  sub.setIntraProcess(false);
+  sub.subscribe("/wakeup_latency", boost::bind(&callback, _1));
+  usleep(500000); //let the subscriber connect
+
+  std_msgs::Float64 msg;
+  uint64_t period_ns = (uint64_t) (1e9 / RATE_HZ);
+  uint64_t next_ns = shared_memory_interface::monotonicNanoseconds();
+  for(int i = 0; i < NUM_MESSAGES && ros::ok(); i++)
+  {
+    next_ns += period_ns;
+    uint64_t now = shared_memory_interface::monotonicNanoseconds();
+    if(next_ns > now)
+    {
+      usleep((next_ns - now) / 1000);
+    }
+    msg.data = i;
+    publish_ns[i] = shared_memory_interface::monotonicNanoseconds();
+    pub.publish(msg);
+  }
+  usleep(2 * period_ns / 1000 + SLOW_MS * 1000); //give the last message a chance to arrive
+
+  std::vector<double> latencies_ms;
+  int never_seen = 0;
+  for(int i = 0; i < NUM_MESSAGES; i++)
+  {
+    if(i > newest_seen)
+    {
+      never_seen++;
+      continue;
+    }
+    latencies_ms.push_back((seen_ns[i] - publish_ns[i]) * 1e-6);
+  }
+  if(latencies_ms.empty())
+  {
+    ROS_ERROR("The subscriber never saw a message!");
+    return 1;
+  }
+  std::sort(latencies_ms.begin(), latencies_ms.end());
+
+  ROS_INFO_STREAM("Wakeup latency statistics (publish to first sighting, " << RATE_HZ << " Hz, every " << SLOW_EVERY << "th callback takes " << SLOW_MS << " ms):\n"
+    << " - Messages published: " << NUM_MESSAGES << "\n"
+    << " - Never seen: " << never_seen << "\n"
+    << " - p50: " << percentile(latencies_ms, 0.5) << " ms\n"
+    << " - p99: " << percentile(latencies_ms, 0.99) << " ms\n"
+    << " - p99.9: " << percentile(latencies_ms, 0.999) << " ms\n"
+    << " - max: " << latencies_ms.back() << " ms");
+  return 0;
+}